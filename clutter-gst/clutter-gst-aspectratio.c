@@ -77,6 +77,7 @@ clutter_gst_aspectratio_get_frame_box (ClutterGstAspectratio *self,
   gfloat actor_width, actor_height;
   gdouble new_width, new_height;
   gdouble frame_aspect, actor_aspect;
+  gint frame_width, frame_height;
 
   actor_width = clutter_actor_box_get_width (content_box);
   actor_height = clutter_actor_box_get_height (content_box);
@@ -84,7 +85,8 @@ clutter_gst_aspectratio_get_frame_box (ClutterGstAspectratio *self,
   if (actor_width <= 0 || actor_height <= 0)
     return;
 
-  frame_aspect = (gdouble) frame->resolution.width / (gdouble) frame->resolution.height;
+  clutter_gst_frame_get_display_size (frame, &frame_width, &frame_height);
+  frame_aspect = (gdouble) frame_width / (gdouble) frame_height;
   actor_aspect = actor_width / actor_height;
 
   if (priv->fill_allocation)
@@ -144,23 +146,27 @@ clutter_gst_aspectratio_get_overlay_box (ClutterGstAspectratio *self,
 {
   gfloat box_width = frame_box->x2 - frame_box->x1,
     box_height = frame_box->y2 - frame_box->y1;
+  gint frame_width, frame_height;
+
+  /* The positions of the overlays are those in the displayed frame */
+  clutter_gst_frame_get_display_size (frame, &frame_width, &frame_height);
 
   /* texturing input */
-  input_box->x1 = (overlay->position.x1 - MAX (frame_input->x1 * frame->resolution.width, overlay->position.x1))
+  input_box->x1 = (overlay->position.x1 - MAX (frame_input->x1 * frame_width, overlay->position.x1))
     / (overlay->position.x2 - overlay->position.x1);
-  input_box->y1 = (overlay->position.y1 - MAX (frame_input->y1 * frame->resolution.height, overlay->position.y1))
+  input_box->y1 = (overlay->position.y1 - MAX (frame_input->y1 * frame_height, overlay->position.y1))
     / (overlay->position.y2 - overlay->position.y1);
-  input_box->x2 = 1 - (overlay->position.x2 - MIN (frame_input->x2 * frame->resolution.width, overlay->position.x2))
+  input_box->x2 = 1 - (overlay->position.x2 - MIN (frame_input->x2 * frame_width, overlay->position.x2))
     / (overlay->position.x2 - overlay->position.x1);
-  input_box->y2 = 1 - (overlay->position.y2 - MIN (frame_input->y2 * frame->resolution.height, overlay->position.y2))
+  input_box->y2 = 1 - (overlay->position.y2 - MIN (frame_input->y2 * frame_height, overlay->position.y2))
     / (overlay->position.y2 - overlay->position.y1);
 
   /* vertex output */
   /* TODO: need some clipping here */
-  paint_box->x1 = frame_box->x1 + overlay->position.x1 * box_width / frame->resolution.width;
-  paint_box->y1 = frame_box->y1 + overlay->position.y1 * box_height / frame->resolution.height;
-  paint_box->x2 = frame_box->x1 + overlay->position.x2 * box_width / frame->resolution.width;
-  paint_box->y2 = frame_box->y1 + overlay->position.y2 * box_height / frame->resolution.height;
+  paint_box->x1 = frame_box->x1 + overlay->position.x1 * box_width / frame_width;
+  paint_box->y1 = frame_box->y1 + overlay->position.y1 * box_height / frame_height;
+  paint_box->x2 = frame_box->x1 + overlay->position.x2 * box_width / frame_width;
+  paint_box->y2 = frame_box->y1 + overlay->position.y2 * box_height / frame_height;
 }
 
 /**/
@@ -172,14 +178,17 @@ clutter_gst_aspectratio_get_preferred_size (ClutterContent *content,
 {
   ClutterGstFrame *frame =
     clutter_gst_content_get_frame (CLUTTER_GST_CONTENT (content));
+  gint frame_width, frame_height;
 
   if (!frame)
     return FALSE;
 
+  clutter_gst_frame_get_display_size (frame, &frame_width, &frame_height);
+
   if (width)
-    *width = frame->resolution.width;
+    *width = frame_width;
   if (height)
-    *height = frame->resolution.height;
+    *height = frame_height;
 
   return TRUE;
 }
@@ -193,6 +202,7 @@ clutter_gst_aspectratio_paint_content (ClutterContent   *content,
   ClutterGstAspectratioPrivate *priv = self->priv;
   ClutterGstContent *gst_content = CLUTTER_GST_CONTENT (content);
   ClutterGstFrame *frame = clutter_gst_content_get_frame (gst_content);
+  ClutterGstVideoSink *sink = clutter_gst_content_get_sink (gst_content);
   ClutterGstBox input_box, paint_box;
   ClutterActorBox content_box;
   ClutterPaintNode *node;
@@ -201,6 +211,10 @@ clutter_gst_aspectratio_paint_content (ClutterContent   *content,
 
   clutter_actor_get_content_box (actor, &content_box);
 
+  if (sink)
+    clutter_gst_video_sink_set_paint_stage (sink,
+                                            CLUTTER_STAGE (clutter_actor_get_stage (actor)));
+
   if (!frame)
     {
       /* No frame to paint, just paint the background color of the
@@ -283,14 +297,29 @@ clutter_gst_aspectratio_paint_content (ClutterContent   *content,
 
       if (overlays)
         {
+          ClutterPaintNode *atlas_node = NULL;
           guint i;
 
+          if (overlays->pipeline)
+            {
+              cogl_pipeline_set_color4ub (overlays->pipeline,
+                                          paint_opacity, paint_opacity,
+                                          paint_opacity, paint_opacity);
+
+              atlas_node = clutter_pipeline_node_new (overlays->pipeline);
+              clutter_paint_node_set_name (atlas_node, "AspectRatioVideoOverlays");
+              clutter_paint_node_add_child (root, atlas_node);
+            }
+
           for (i = 0; i < overlays->overlays->len; i++)
             {
               ClutterGstOverlay *overlay =
                 g_ptr_array_index (overlays->overlays, i);
+              const ClutterGstBox *region = &overlay->atlas_region;
               ClutterGstBox overlay_box;
               ClutterGstBox overlay_input_box;
+              gfloat region_width = clutter_gst_box_get_width (region),
+                region_height = clutter_gst_box_get_height (region);
 
               clutter_gst_aspectratio_get_overlay_box (self,
                                                        &overlay_input_box,
@@ -300,22 +329,38 @@ clutter_gst_aspectratio_paint_content (ClutterContent   *content,
                                                        frame,
                                                        overlay);
 
-              cogl_pipeline_set_color4ub (overlay->pipeline,
-                                          paint_opacity, paint_opacity,
-                                          paint_opacity, paint_opacity);
-
-              node = clutter_pipeline_node_new (overlay->pipeline);
-              clutter_paint_node_set_name (node, "AspectRatioVideoOverlay");
+              /* Overlays that didn't fit in the atlas are painted on
+               * their own */
+              if (overlay->in_atlas)
+                {
+                  if (atlas_node == NULL)
+                    continue;
+
+                  node = clutter_paint_node_ref (atlas_node);
+                }
+              else
+                {
+                  cogl_pipeline_set_color4ub (overlay->pipeline,
+                                              paint_opacity, paint_opacity,
+                                              paint_opacity, paint_opacity);
+
+                  node = clutter_pipeline_node_new (overlay->pipeline);
+                  clutter_paint_node_add_child (root, node);
+                }
 
               clutter_paint_node_add_texture_rectangle_custom (node,
                                                                overlay_box.x1, overlay_box.y1,
                                                                overlay_box.x2, overlay_box.y2,
-                                                               overlay_input_box.x1, overlay_input_box.y1,
-                                                               overlay_input_box.x2, overlay_input_box.y2);
+                                                               region->x1 + overlay_input_box.x1 * region_width,
+                                                               region->y1 + overlay_input_box.y1 * region_height,
+                                                               region->x1 + overlay_input_box.x2 * region_width,
+                                                               region->y1 + overlay_input_box.y2 * region_height);
 
-              clutter_paint_node_add_child (root, node);
               clutter_paint_node_unref (node);
             }
+
+          if (atlas_node)
+            clutter_paint_node_unref (atlas_node);
         }
     }
 }
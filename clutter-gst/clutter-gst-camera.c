@@ -749,7 +749,7 @@ _pixel_aspect_ratio_changed (ClutterGstVideoSink *sink,
                              GParamSpec          *spec,
                              ClutterGstCamera    *self)
 {
-  clutter_gst_frame_update_pixel_aspect_ratio (self->priv->current_frame, sink);
+  clutter_gst_frame_update_pixel_aspect_ratio (&self->priv->current_frame, sink);
 }
 
 static gboolean
@@ -146,27 +146,20 @@ update_frame (ClutterGstContent *self,
 {
   ClutterGstContentPrivate *priv = self->priv;
   ClutterGstFrame *old_frame;
+  gint old_width = 0, old_height = 0, new_width, new_height;
 
   old_frame = priv->current_frame;
-  priv->current_frame = g_boxed_copy (CLUTTER_GST_TYPE_FRAME, new_frame);
+  priv->current_frame = clutter_gst_frame_ref (new_frame);
 
   if (old_frame)
-    {
-      new_frame->resolution.par_n = old_frame->resolution.par_n;
-      new_frame->resolution.par_d = old_frame->resolution.par_d;
-    }
+    clutter_gst_frame_get_display_size (old_frame, &old_width, &old_height);
+  clutter_gst_frame_get_display_size (new_frame, &new_width, &new_height);
 
-  if (!old_frame ||
-      (new_frame->resolution.width != old_frame->resolution.width ||
-       new_frame->resolution.height != old_frame->resolution.height))
-    {
-      g_signal_emit (self, signals[SIZE_CHANGE], 0,
-                     new_frame->resolution.width,
-                     new_frame->resolution.height);
-    }
+  if (!old_frame || new_width != old_width || new_height != old_height)
+    g_signal_emit (self, signals[SIZE_CHANGE], 0, new_width, new_height);
 
   if (old_frame)
-    g_boxed_free (CLUTTER_GST_TYPE_FRAME, old_frame);
+    clutter_gst_frame_unref (old_frame);
 }
 
 static void
@@ -177,11 +170,11 @@ update_overlays (ClutterGstContent  *self,
 
   if (priv->overlays != NULL)
     {
-      g_boxed_free (CLUTTER_GST_TYPE_OVERLAYS, priv->overlays);
+      clutter_gst_overlays_unref (priv->overlays);
       priv->overlays = NULL;
     }
   if (new_overlays != NULL)
-    priv->overlays = g_boxed_copy (CLUTTER_GST_TYPE_OVERLAYS, new_overlays);
+    priv->overlays = clutter_gst_overlays_ref (new_overlays);
 }
 
 static void
@@ -209,7 +202,7 @@ _pixel_aspect_ratio_changed (ClutterGstVideoSink *sink,
                              GParamSpec          *pspec,
                              ClutterGstContent   *self)
 {
-  clutter_gst_frame_update_pixel_aspect_ratio (self->priv->current_frame,
+  clutter_gst_frame_update_pixel_aspect_ratio (&self->priv->current_frame,
                                                sink);
 }
 
@@ -292,7 +285,7 @@ content_set_frame (ClutterGstContent *self,
     {
       if (priv->current_frame)
         {
-          g_boxed_free (CLUTTER_GST_TYPE_FRAME, priv->current_frame);
+          clutter_gst_frame_unref (priv->current_frame);
           priv->current_frame = NULL;
 
           clutter_content_invalidate (CLUTTER_CONTENT (self));
@@ -312,14 +305,18 @@ clutter_gst_content_get_preferred_size (ClutterContent *content,
                                         gfloat         *height)
 {
   ClutterGstContentPrivate *priv = CLUTTER_GST_CONTENT (content)->priv;
+  gint frame_width, frame_height;
 
   if (!priv->current_frame)
     return FALSE;
 
+  clutter_gst_frame_get_display_size (priv->current_frame,
+                                      &frame_width, &frame_height);
+
   if (width)
-    *width = priv->current_frame->resolution.width;
+    *width = frame_width;
   if (height)
-    *height = priv->current_frame->resolution.height;
+    *height = frame_height;
 
   return TRUE;
 }
@@ -339,6 +336,10 @@ clutter_gst_content_paint_content (ClutterContent   *content,
   clutter_actor_get_content_box (actor, &box);
   paint_opacity = clutter_actor_get_paint_opacity (actor);
 
+  if (priv->sink)
+    clutter_gst_video_sink_set_paint_stage (priv->sink,
+                                            CLUTTER_STAGE (clutter_actor_get_stage (actor)));
+
   /* No content: paint background color */
   if (!CLUTTER_GST_CONTENT_GET_CLASS (self)->has_painting_content (self))
     {
@@ -372,12 +373,16 @@ clutter_gst_content_paint_content (ClutterContent   *content,
       else
         {
           float t_w = 1.f, t_h = 1.f;
+          gint frame_width, frame_height;
+
+          clutter_gst_frame_get_display_size (priv->current_frame,
+                                              &frame_width, &frame_height);
 
           if ((repeat & CLUTTER_REPEAT_X_AXIS) != FALSE)
-            t_w = (box.x2 - box.x1) / priv->current_frame->resolution.width;
+            t_w = (box.x2 - box.x1) / frame_width;
 
           if ((repeat & CLUTTER_REPEAT_Y_AXIS) != FALSE)
-            t_h = (box.y2 - box.y1) / priv->current_frame->resolution.height;
+            t_h = (box.y2 - box.y1) / frame_height;
 
           clutter_paint_node_add_texture_rectangle (node, &box,
                                                     0.f, 0.f,
@@ -390,35 +395,68 @@ clutter_gst_content_paint_content (ClutterContent   *content,
 
   if (priv->paint_overlays && priv->overlays)
     {
+      gfloat box_width = clutter_actor_box_get_width (&box),
+        box_height = clutter_actor_box_get_height (&box);
+      ClutterPaintNode *atlas_node = NULL;
+      gint frame_width, frame_height;
       guint i;
 
+      /* The positions of the overlays are those in the displayed frame */
+      clutter_gst_frame_get_display_size (priv->current_frame,
+                                          &frame_width, &frame_height);
+
+      /* The overlays living in the atlas are painted with a single node,
+       * which lets Cogl batch them into one draw */
+      if (priv->overlays->pipeline)
+        {
+          cogl_pipeline_set_color4ub (priv->overlays->pipeline,
+                                      paint_opacity, paint_opacity,
+                                      paint_opacity, paint_opacity);
+
+          atlas_node = clutter_pipeline_node_new (priv->overlays->pipeline);
+          clutter_paint_node_set_name (atlas_node, "VideoOverlays");
+          clutter_paint_node_add_child (root, atlas_node);
+        }
+
       for (i = 0; i < priv->overlays->overlays->len; i++)
         {
           ClutterGstOverlay *overlay =
             g_ptr_array_index (priv->overlays->overlays, i);
-          gfloat box_width = clutter_actor_box_get_width (&box),
-            box_height = clutter_actor_box_get_height (&box);
           ClutterActorBox obox = {
-            overlay->position.x1 * box_width / priv->current_frame->resolution.width,
-            overlay->position.y1 * box_height / priv->current_frame->resolution.height,
-            overlay->position.x2 * box_width / priv->current_frame->resolution.width,
-            overlay->position.y2 * box_height / priv->current_frame->resolution.height
+            overlay->position.x1 * box_width / frame_width,
+            overlay->position.y1 * box_height / frame_height,
+            overlay->position.x2 * box_width / frame_width,
+            overlay->position.y2 * box_height / frame_height
           };
 
+          if (overlay->in_atlas)
+            {
+              if (atlas_node)
+                clutter_paint_node_add_texture_rectangle (atlas_node, &obox,
+                                                          overlay->atlas_region.x1,
+                                                          overlay->atlas_region.y1,
+                                                          overlay->atlas_region.x2,
+                                                          overlay->atlas_region.y2);
+              continue;
+            }
+
           cogl_pipeline_set_color4ub (overlay->pipeline,
                                       paint_opacity, paint_opacity,
                                       paint_opacity, paint_opacity);
 
           node = clutter_pipeline_node_new (overlay->pipeline);
           clutter_paint_node_set_name (node, "VideoOverlay");
-
           clutter_paint_node_add_texture_rectangle (node, &obox,
-                                                    0, 0,
-                                                    1, 1);
-
+                                                    overlay->atlas_region.x1,
+                                                    overlay->atlas_region.y1,
+                                                    overlay->atlas_region.x2,
+                                                    overlay->atlas_region.y2);
           clutter_paint_node_add_child (root, node);
           clutter_paint_node_unref (node);
         }
+
+      if (atlas_node)
+        clutter_paint_node_unref (atlas_node);
     }
 }
 
@@ -511,10 +549,16 @@ clutter_gst_content_dispose (GObject *object)
 
   if (priv->current_frame)
     {
-      g_boxed_free (CLUTTER_GST_TYPE_FRAME, priv->current_frame);
+      clutter_gst_frame_unref (priv->current_frame);
       priv->current_frame = NULL;
     }
 
+  if (priv->overlays)
+    {
+      clutter_gst_overlays_unref (priv->overlays);
+      priv->overlays = NULL;
+    }
+
   G_OBJECT_CLASS (clutter_gst_content_parent_class)->dispose (object);
 }
 
@@ -0,0 +1,790 @@
+/*
+ * Clutter-GStreamer.
+ *
+ * GStreamer integration library for Clutter.
+ *
+ * clutter-gst-cpu-convert.c - YUV to RGB conversion on the CPU, for
+ *                             contexts without GLSL support.
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Without GLSL the sink can't convert YUV frames while sampling them,
+ * so I420, NV12 and YUY2 frames are converted to RGBx here before
+ * being uploaded.
+ *
+ * The conversion uses 8.8 fixed point coefficients, each term being
+ * computed as ((x * coefficient) >> 8). That is exactly what the
+ * multiply high instructions give on 16 bits lanes once x has been
+ * shifted left by 7 (and the coefficient doubled for SSE2/AVX2, NEON
+ * doing the doubling itself), so all the code paths below produce the
+ * same output. The SSE2 and NEON rows are used when the compiler
+ * targets them, the AVX2 ones are picked at runtime.
+ *
+ * Frames are split in horizontal slices converted in parallel by a
+ * small thread pool, the calling thread converting the first slice.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "clutter-gst-cpu-convert.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_AVX2_ROWS 1
+#include <immintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HAVE_NEON_ROWS 1
+#include <arm_neon.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (clutter_gst_cpu_convert_debug);
+#define GST_CAT_DEFAULT clutter_gst_cpu_convert_debug
+
+/* Don't bother waking up threads for less than this many rows */
+#define MIN_ROWS_PER_SLICE (64)
+#define MAX_THREADS (4)
+
+typedef struct
+{
+  gint16 y_offset;
+  gint16 y;
+  gint16 rv;
+  gint16 gu;
+  gint16 gv;
+  gint16 bu;
+} ClutterGstCpuCoeffs;
+
+static const ClutterGstCpuCoeffs bt601_coeffs = { 16, 298, 409, 100, 208, 516 };
+static const ClutterGstCpuCoeffs bt709_coeffs = { 16, 298, 459, 55, 136, 541 };
+static const ClutterGstCpuCoeffs bt601_full_coeffs = { 0, 256, 359, 88, 183, 454 };
+static const ClutterGstCpuCoeffs bt709_full_coeffs = { 0, 256, 403, 48, 120, 475 };
+
+/* Converts a row of @width pixels. For planar formats @c0 and @c1 are
+ * the U and V rows, for semi planar formats @c0 is the UV row, packed
+ * formats only use @y. */
+typedef void (*ClutterGstCpuRowFunc) (const guint8 *y,
+                                      const guint8 *c0,
+                                      const guint8 *c1,
+                                      guint8 *dest,
+                                      gint width,
+                                      const ClutterGstCpuCoeffs *k);
+
+typedef struct
+{
+  const gchar *name;
+  ClutterGstCpuRowFunc planar;
+  ClutterGstCpuRowFunc semi_planar;
+  ClutterGstCpuRowFunc yuy2;
+} ClutterGstCpuRows;
+
+struct _ClutterGstCpuConverter
+{
+  const ClutterGstCpuRows *rows;
+
+  GThreadPool *pool;
+  guint n_threads;
+
+  GMutex lock;
+  GCond cond;
+  guint pending;
+};
+
+typedef struct
+{
+  ClutterGstCpuConverter *converter;
+  ClutterGstCpuRowFunc row;
+  const GstVideoFrame *src;
+  const ClutterGstCpuCoeffs *coeffs;
+  guint8 *dest;
+  gint dest_stride;
+  gint first_row;
+  gint last_row;
+} ClutterGstCpuSlice;
+
+/* Generic rows */
+
+static inline guint8
+clamp_component (gint value)
+{
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static inline void
+convert_pixel (gint y, gint u, gint v,
+               guint8 *dest,
+               const ClutterGstCpuCoeffs *k)
+{
+  gint yy = ((y - k->y_offset) * k->y) >> 8;
+
+  u -= 128;
+  v -= 128;
+
+  dest[0] = clamp_component (yy + ((v * k->rv) >> 8));
+  dest[1] = clamp_component (yy - ((u * k->gu) >> 8) - ((v * k->gv) >> 8));
+  dest[2] = clamp_component (yy + ((u * k->bu) >> 8));
+  dest[3] = 0xff;
+}
+
+static inline void
+convert_planar_tail (const guint8 *y, const guint8 *u, const guint8 *v,
+                     guint8 *dest, gint x, gint width,
+                     const ClutterGstCpuCoeffs *k)
+{
+  for (; x < width; x++)
+    convert_pixel (y[x], u[x / 2], v[x / 2], dest + x * 4, k);
+}
+
+static inline void
+convert_semi_planar_tail (const guint8 *y, const guint8 *uv,
+                          guint8 *dest, gint x, gint width,
+                          const ClutterGstCpuCoeffs *k)
+{
+  for (; x < width; x++)
+    convert_pixel (y[x], uv[x / 2 * 2], uv[x / 2 * 2 + 1], dest + x * 4, k);
+}
+
+static inline void
+convert_yuy2_tail (const guint8 *yuy2,
+                   guint8 *dest, gint x, gint width,
+                   const ClutterGstCpuCoeffs *k)
+{
+  for (; x < width; x++)
+    convert_pixel (yuy2[x * 2], yuy2[x / 2 * 4 + 1], yuy2[x / 2 * 4 + 3],
+                   dest + x * 4, k);
+}
+
+static void
+convert_planar_row_c (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                      guint8 *dest, gint width,
+                      const ClutterGstCpuCoeffs *k)
+{
+  convert_planar_tail (y, c0, c1, dest, 0, width, k);
+}
+
+static void
+convert_semi_planar_row_c (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                           guint8 *dest, gint width,
+                           const ClutterGstCpuCoeffs *k)
+{
+  convert_semi_planar_tail (y, c0, dest, 0, width, k);
+}
+
+static void
+convert_yuy2_row_c (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                    guint8 *dest, gint width,
+                    const ClutterGstCpuCoeffs *k)
+{
+  convert_yuy2_tail (y, dest, 0, width, k);
+}
+
+static const ClutterGstCpuRows c_rows =
+  {
+    "C",
+    convert_planar_row_c,
+    convert_semi_planar_row_c,
+    convert_yuy2_row_c,
+  };
+
+/* SSE2 rows, 8 pixels at a time */
+
+#if defined (__SSE2__)
+
+/* @y, @u and @v hold one 16 bits value per pixel */
+static inline void
+convert_8_sse2 (__m128i y, __m128i u, __m128i v,
+                guint8 *dest,
+                const ClutterGstCpuCoeffs *k)
+{
+  __m128i yy, r, g, b, rg, bx;
+
+  y = _mm_slli_epi16 (_mm_sub_epi16 (y, _mm_set1_epi16 (k->y_offset)), 7);
+  u = _mm_slli_epi16 (_mm_sub_epi16 (u, _mm_set1_epi16 (128)), 7);
+  v = _mm_slli_epi16 (_mm_sub_epi16 (v, _mm_set1_epi16 (128)), 7);
+
+  yy = _mm_mulhi_epi16 (y, _mm_set1_epi16 (k->y * 2));
+  r = _mm_add_epi16 (yy, _mm_mulhi_epi16 (v, _mm_set1_epi16 (k->rv * 2)));
+  g = _mm_sub_epi16 (_mm_sub_epi16 (yy,
+                                    _mm_mulhi_epi16 (u, _mm_set1_epi16 (k->gu * 2))),
+                     _mm_mulhi_epi16 (v, _mm_set1_epi16 (k->gv * 2)));
+  b = _mm_add_epi16 (yy, _mm_mulhi_epi16 (u, _mm_set1_epi16 (k->bu * 2)));
+
+  r = _mm_packus_epi16 (r, r);
+  g = _mm_packus_epi16 (g, g);
+  b = _mm_packus_epi16 (b, b);
+
+  rg = _mm_unpacklo_epi8 (r, g);
+  bx = _mm_unpacklo_epi8 (b, _mm_set1_epi8 ((char) 0xff));
+
+  _mm_storeu_si128 ((__m128i *) dest, _mm_unpacklo_epi16 (rg, bx));
+  _mm_storeu_si128 ((__m128i *) (dest + 16), _mm_unpackhi_epi16 (rg, bx));
+}
+
+/* Splits 8 interleaved 16 bits U and V values into 2 vectors with each
+ * value doubled, for the 2 pixels sharing it */
+static inline void
+split_chroma_sse2 (__m128i uv, __m128i *u, __m128i *v)
+{
+  *u = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (uv, _MM_SHUFFLE (2, 2, 0, 0)),
+                            _MM_SHUFFLE (2, 2, 0, 0));
+  *v = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (uv, _MM_SHUFFLE (3, 3, 1, 1)),
+                            _MM_SHUFFLE (3, 3, 1, 1));
+}
+
+static void
+convert_planar_row_sse2 (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                         guint8 *dest, gint width,
+                         const ClutterGstCpuCoeffs *k)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    {
+      __m128i yv, u, v;
+      gint32 u4, v4;
+
+      memcpy (&u4, c0 + x / 2, 4);
+      memcpy (&v4, c1 + x / 2, 4);
+
+      yv = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (y + x)),
+                              zero);
+      u = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (u4), zero);
+      v = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (v4), zero);
+
+      convert_8_sse2 (yv, _mm_unpacklo_epi16 (u, u), _mm_unpacklo_epi16 (v, v),
+                      dest + x * 4, k);
+    }
+
+  convert_planar_tail (y, c0, c1, dest, x, width, k);
+}
+
+static void
+convert_semi_planar_row_sse2 (const guint8 *y, const guint8 *c0,
+                              const guint8 *c1, guint8 *dest, gint width,
+                              const ClutterGstCpuCoeffs *k)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    {
+      __m128i yv, uv, u, v;
+
+      yv = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (y + x)),
+                              zero);
+      uv = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (c0 + x)),
+                              zero);
+      split_chroma_sse2 (uv, &u, &v);
+
+      convert_8_sse2 (yv, u, v, dest + x * 4, k);
+    }
+
+  convert_semi_planar_tail (y, c0, dest, x, width, k);
+}
+
+static void
+convert_yuy2_row_sse2 (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                       guint8 *dest, gint width,
+                       const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    {
+      __m128i yuy2, yv, u, v;
+
+      yuy2 = _mm_loadu_si128 ((const __m128i *) (y + x * 2));
+      yv = _mm_and_si128 (yuy2, _mm_set1_epi16 (0xff));
+      split_chroma_sse2 (_mm_srli_epi16 (yuy2, 8), &u, &v);
+
+      convert_8_sse2 (yv, u, v, dest + x * 4, k);
+    }
+
+  convert_yuy2_tail (y, dest, x, width, k);
+}
+
+static const ClutterGstCpuRows sse2_rows =
+  {
+    "SSE2",
+    convert_planar_row_sse2,
+    convert_semi_planar_row_sse2,
+    convert_yuy2_row_sse2,
+  };
+
+#endif /* __SSE2__ */
+
+/* AVX2 rows, 16 pixels at a time. The 256 bits unpack and shuffle
+ * instructions work within each 128 bits lane, so the first 8 pixels
+ * are kept in the low lane and the next 8 in the high one. */
+
+#ifdef HAVE_AVX2_ROWS
+
+__attribute__ ((target ("avx2"))) static inline void
+convert_16_avx2 (__m256i y, __m256i u, __m256i v,
+                 guint8 *dest,
+                 const ClutterGstCpuCoeffs *k)
+{
+  __m256i yy, r, g, b, rg, bx, lo, hi;
+
+  y = _mm256_slli_epi16 (_mm256_sub_epi16 (y, _mm256_set1_epi16 (k->y_offset)), 7);
+  u = _mm256_slli_epi16 (_mm256_sub_epi16 (u, _mm256_set1_epi16 (128)), 7);
+  v = _mm256_slli_epi16 (_mm256_sub_epi16 (v, _mm256_set1_epi16 (128)), 7);
+
+  yy = _mm256_mulhi_epi16 (y, _mm256_set1_epi16 (k->y * 2));
+  r = _mm256_add_epi16 (yy, _mm256_mulhi_epi16 (v, _mm256_set1_epi16 (k->rv * 2)));
+  g = _mm256_sub_epi16 (_mm256_sub_epi16 (yy,
+                                          _mm256_mulhi_epi16 (u, _mm256_set1_epi16 (k->gu * 2))),
+                        _mm256_mulhi_epi16 (v, _mm256_set1_epi16 (k->gv * 2)));
+  b = _mm256_add_epi16 (yy, _mm256_mulhi_epi16 (u, _mm256_set1_epi16 (k->bu * 2)));
+
+  r = _mm256_packus_epi16 (r, r);
+  g = _mm256_packus_epi16 (g, g);
+  b = _mm256_packus_epi16 (b, b);
+
+  rg = _mm256_unpacklo_epi8 (r, g);
+  bx = _mm256_unpacklo_epi8 (b, _mm256_set1_epi8 ((char) 0xff));
+
+  /* Pixels 0-3 and 8-11, then 4-7 and 12-15 */
+  lo = _mm256_unpacklo_epi16 (rg, bx);
+  hi = _mm256_unpackhi_epi16 (rg, bx);
+
+  _mm256_storeu_si256 ((__m256i *) dest,
+                       _mm256_permute2x128_si256 (lo, hi, 0x20));
+  _mm256_storeu_si256 ((__m256i *) (dest + 32),
+                       _mm256_permute2x128_si256 (lo, hi, 0x31));
+}
+
+__attribute__ ((target ("avx2"))) static inline void
+split_chroma_avx2 (__m256i uv, __m256i *u, __m256i *v)
+{
+  *u = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (uv, _MM_SHUFFLE (2, 2, 0, 0)),
+                               _MM_SHUFFLE (2, 2, 0, 0));
+  *v = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (uv, _MM_SHUFFLE (3, 3, 1, 1)),
+                               _MM_SHUFFLE (3, 3, 1, 1));
+}
+
+/* Doubles 8 chroma values, in order */
+__attribute__ ((target ("avx2"))) static inline __m256i
+double_chroma_avx2 (const guint8 *c)
+{
+  __m128i c16 = _mm_cvtepu8_epi16 (_mm_loadl_epi64 ((const __m128i *) c));
+
+  return _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_unpacklo_epi16 (c16, c16)),
+                                  _mm_unpackhi_epi16 (c16, c16), 1);
+}
+
+__attribute__ ((target ("avx2"))) static void
+convert_planar_row_avx2 (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                         guint8 *dest, gint width,
+                         const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16)
+    {
+      __m256i yv;
+
+      yv = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (y + x)));
+
+      convert_16_avx2 (yv,
+                       double_chroma_avx2 (c0 + x / 2),
+                       double_chroma_avx2 (c1 + x / 2),
+                       dest + x * 4, k);
+    }
+
+  convert_planar_tail (y, c0, c1, dest, x, width, k);
+}
+
+__attribute__ ((target ("avx2"))) static void
+convert_semi_planar_row_avx2 (const guint8 *y, const guint8 *c0,
+                              const guint8 *c1, guint8 *dest, gint width,
+                              const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16)
+    {
+      __m256i yv, uv, u, v;
+
+      yv = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (y + x)));
+      uv = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (c0 + x)));
+      split_chroma_avx2 (uv, &u, &v);
+
+      convert_16_avx2 (yv, u, v, dest + x * 4, k);
+    }
+
+  convert_semi_planar_tail (y, c0, dest, x, width, k);
+}
+
+__attribute__ ((target ("avx2"))) static void
+convert_yuy2_row_avx2 (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                       guint8 *dest, gint width,
+                       const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16)
+    {
+      __m256i yuy2, yv, u, v;
+
+      yuy2 = _mm256_loadu_si256 ((const __m256i *) (y + x * 2));
+      yv = _mm256_and_si256 (yuy2, _mm256_set1_epi16 (0xff));
+      split_chroma_avx2 (_mm256_srli_epi16 (yuy2, 8), &u, &v);
+
+      convert_16_avx2 (yv, u, v, dest + x * 4, k);
+    }
+
+  convert_yuy2_tail (y, dest, x, width, k);
+}
+
+static const ClutterGstCpuRows avx2_rows =
+  {
+    "AVX2",
+    convert_planar_row_avx2,
+    convert_semi_planar_row_avx2,
+    convert_yuy2_row_avx2,
+  };
+
+#endif /* HAVE_AVX2_ROWS */
+
+/* NEON rows, 8 pixels at a time. vqdmulh doubles the product itself so
+ * the coefficients are used as they are. */
+
+#ifdef HAVE_NEON_ROWS
+
+static inline void
+convert_8_neon (int16x8_t y, int16x8_t u, int16x8_t v,
+                guint8 *dest,
+                const ClutterGstCpuCoeffs *k)
+{
+  int16x8_t yy, r, g, b;
+  uint8x8x4_t rgbx;
+
+  y = vshlq_n_s16 (vsubq_s16 (y, vdupq_n_s16 (k->y_offset)), 7);
+  u = vshlq_n_s16 (vsubq_s16 (u, vdupq_n_s16 (128)), 7);
+  v = vshlq_n_s16 (vsubq_s16 (v, vdupq_n_s16 (128)), 7);
+
+  yy = vqdmulhq_s16 (y, vdupq_n_s16 (k->y));
+  r = vaddq_s16 (yy, vqdmulhq_s16 (v, vdupq_n_s16 (k->rv)));
+  g = vsubq_s16 (vsubq_s16 (yy, vqdmulhq_s16 (u, vdupq_n_s16 (k->gu))),
+                 vqdmulhq_s16 (v, vdupq_n_s16 (k->gv)));
+  b = vaddq_s16 (yy, vqdmulhq_s16 (u, vdupq_n_s16 (k->bu)));
+
+  rgbx.val[0] = vqmovun_s16 (r);
+  rgbx.val[1] = vqmovun_s16 (g);
+  rgbx.val[2] = vqmovun_s16 (b);
+  rgbx.val[3] = vdup_n_u8 (0xff);
+
+  vst4_u8 (dest, rgbx);
+}
+
+static inline int16x8_t
+widen_neon (uint8x8_t values)
+{
+  return vreinterpretq_s16_u16 (vmovl_u8 (values));
+}
+
+/* Splits 4 interleaved U and V pairs into 2 vectors with each value
+ * doubled, for the 2 pixels sharing it */
+static inline void
+split_chroma_neon (uint8x8_t uv, int16x8_t *u, int16x8_t *v)
+{
+  uint8x8x2_t split = vuzp_u8 (uv, uv);
+
+  *u = widen_neon (vzip_u8 (split.val[0], split.val[0]).val[0]);
+  *v = widen_neon (vzip_u8 (split.val[1], split.val[1]).val[0]);
+}
+
+static inline int16x8_t
+double_chroma_neon (const guint8 *c)
+{
+  guint32 c4;
+  uint8x8_t values;
+
+  memcpy (&c4, c, 4);
+  values = vreinterpret_u8_u32 (vdup_n_u32 (c4));
+
+  return widen_neon (vzip_u8 (values, values).val[0]);
+}
+
+static void
+convert_planar_row_neon (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                         guint8 *dest, gint width,
+                         const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    convert_8_neon (widen_neon (vld1_u8 (y + x)),
+                    double_chroma_neon (c0 + x / 2),
+                    double_chroma_neon (c1 + x / 2),
+                    dest + x * 4, k);
+
+  convert_planar_tail (y, c0, c1, dest, x, width, k);
+}
+
+static void
+convert_semi_planar_row_neon (const guint8 *y, const guint8 *c0,
+                              const guint8 *c1, guint8 *dest, gint width,
+                              const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    {
+      int16x8_t u, v;
+
+      split_chroma_neon (vld1_u8 (c0 + x), &u, &v);
+      convert_8_neon (widen_neon (vld1_u8 (y + x)), u, v, dest + x * 4, k);
+    }
+
+  convert_semi_planar_tail (y, c0, dest, x, width, k);
+}
+
+static void
+convert_yuy2_row_neon (const guint8 *y, const guint8 *c0, const guint8 *c1,
+                       guint8 *dest, gint width,
+                       const ClutterGstCpuCoeffs *k)
+{
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    {
+      /* Lumas in val[0], interleaved chromas in val[1] */
+      uint8x8x2_t yuy2 = vld2_u8 (y + x * 2);
+      int16x8_t u, v;
+
+      split_chroma_neon (yuy2.val[1], &u, &v);
+      convert_8_neon (widen_neon (yuy2.val[0]), u, v, dest + x * 4, k);
+    }
+
+  convert_yuy2_tail (y, dest, x, width, k);
+}
+
+static const ClutterGstCpuRows neon_rows =
+  {
+    "NEON",
+    convert_planar_row_neon,
+    convert_semi_planar_row_neon,
+    convert_yuy2_row_neon,
+  };
+
+#endif /* HAVE_NEON_ROWS */
+
+static const ClutterGstCpuRows *
+select_rows (void)
+{
+#ifdef HAVE_AVX2_ROWS
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    return &avx2_rows;
+#endif
+
+#if defined (__SSE2__)
+  return &sse2_rows;
+#elif defined (HAVE_NEON_ROWS)
+  return &neon_rows;
+#endif
+
+  return &c_rows;
+}
+
+/* Slices */
+
+static void
+convert_slice (ClutterGstCpuSlice *slice)
+{
+  const GstVideoFrame *src = slice->src;
+  const GstVideoFormatInfo *finfo = src->info.finfo;
+  gint width = GST_VIDEO_FRAME_WIDTH (src);
+  gint row;
+
+  for (row = slice->first_row; row < slice->last_row; row++)
+    {
+      guint8 *dest = slice->dest + row * slice->dest_stride;
+      const guint8 *y, *c0 = NULL, *c1 = NULL;
+      gint c_row = 0;
+
+      y = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (src, 0) +
+        row * GST_VIDEO_FRAME_PLANE_STRIDE (src, 0);
+
+      if (GST_VIDEO_FRAME_N_PLANES (src) > 1)
+        {
+          /* Row index, not a plane height: no rounding up */
+          c_row = row >> GST_VIDEO_FORMAT_INFO_H_SUB (finfo, 1);
+          c0 = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (src, 1) +
+            c_row * GST_VIDEO_FRAME_PLANE_STRIDE (src, 1);
+        }
+
+      if (GST_VIDEO_FRAME_N_PLANES (src) > 2)
+        c1 = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (src, 2) +
+          c_row * GST_VIDEO_FRAME_PLANE_STRIDE (src, 2);
+
+      slice->row (y, c0, c1, dest, width, slice->coeffs);
+    }
+}
+
+static void
+convert_slice_func (gpointer data,
+                    gpointer user_data)
+{
+  ClutterGstCpuSlice *slice = data;
+  ClutterGstCpuConverter *converter = user_data;
+
+  convert_slice (slice);
+
+  g_mutex_lock (&converter->lock);
+  if (--converter->pending == 0)
+    g_cond_signal (&converter->cond);
+  g_mutex_unlock (&converter->lock);
+}
+
+static const ClutterGstCpuCoeffs *
+get_coeffs (const GstVideoInfo *info)
+{
+  gboolean full_range =
+    info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+
+  if (info->colorimetry.matrix == GST_VIDEO_COLOR_MATRIX_BT709)
+    return full_range ? &bt709_full_coeffs : &bt709_coeffs;
+
+  return full_range ? &bt601_full_coeffs : &bt601_coeffs;
+}
+
+ClutterGstCpuConverter *
+clutter_gst_cpu_converter_new (void)
+{
+  static gsize debug_initialized = 0;
+  ClutterGstCpuConverter *converter;
+
+  if (g_once_init_enter (&debug_initialized))
+    {
+      GST_DEBUG_CATEGORY_INIT (clutter_gst_cpu_convert_debug,
+                               "cluttergstcpuconvert", 0,
+                               "YUV to RGB conversion on the CPU");
+      g_once_init_leave (&debug_initialized, 1);
+    }
+
+  converter = g_slice_new0 (ClutterGstCpuConverter);
+
+  converter->rows = select_rows ();
+  converter->n_threads = CLAMP (g_get_num_processors (), 1, MAX_THREADS);
+
+  g_mutex_init (&converter->lock);
+  g_cond_init (&converter->cond);
+
+  /* The calling thread converts a slice too */
+  if (converter->n_threads > 1)
+    converter->pool = g_thread_pool_new (convert_slice_func, converter,
+                                         converter->n_threads - 1,
+                                         FALSE, NULL);
+
+  GST_DEBUG ("Converting with the %s rows and up to %u threads",
+             converter->rows->name, converter->n_threads);
+
+  return converter;
+}
+
+void
+clutter_gst_cpu_converter_free (ClutterGstCpuConverter *converter)
+{
+  if (converter->pool)
+    g_thread_pool_free (converter->pool, FALSE, TRUE);
+
+  g_mutex_clear (&converter->lock);
+  g_cond_clear (&converter->cond);
+
+  g_slice_free (ClutterGstCpuConverter, converter);
+}
+
+const gchar *
+clutter_gst_cpu_converter_get_name (ClutterGstCpuConverter *converter)
+{
+  return converter->rows->name;
+}
+
+/* Converts @src, an I420, NV12 or YUY2 frame, into RGBx pixels at
+ * @dest. Returns FALSE if the format isn't supported. */
+gboolean
+clutter_gst_cpu_converter_convert (ClutterGstCpuConverter *converter,
+                                   const GstVideoFrame *src,
+                                   guint8 *dest,
+                                   gint dest_stride)
+{
+  ClutterGstCpuSlice slices[MAX_THREADS];
+  ClutterGstCpuRowFunc row;
+  gint height = GST_VIDEO_FRAME_HEIGHT (src);
+  guint n_slices, i;
+
+  switch (GST_VIDEO_FRAME_FORMAT (src))
+    {
+    case GST_VIDEO_FORMAT_I420:
+      row = converter->rows->planar;
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      row = converter->rows->semi_planar;
+      break;
+    case GST_VIDEO_FORMAT_YUY2:
+      row = converter->rows->yuy2;
+      break;
+    default:
+      return FALSE;
+    }
+
+  n_slices = CLAMP ((guint) height / MIN_ROWS_PER_SLICE, 1,
+                    converter->n_threads);
+
+  for (i = 0; i < n_slices; i++)
+    {
+      ClutterGstCpuSlice *slice = &slices[i];
+
+      slice->converter = converter;
+      slice->row = row;
+      slice->src = src;
+      slice->coeffs = get_coeffs (&src->info);
+      slice->dest = dest;
+      slice->dest_stride = dest_stride;
+      slice->first_row = height * i / n_slices;
+      slice->last_row = height * (i + 1) / n_slices;
+    }
+
+  converter->pending = n_slices - 1;
+
+  for (i = 1; i < n_slices; i++)
+    g_thread_pool_push (converter->pool, &slices[i], NULL);
+
+  convert_slice (&slices[0]);
+
+  g_mutex_lock (&converter->lock);
+  while (converter->pending > 0)
+    g_cond_wait (&converter->cond, &converter->lock);
+  g_mutex_unlock (&converter->lock);
+
+  return TRUE;
+}
@@ -0,0 +1,49 @@
+/*
+ * Clutter-GStreamer.
+ *
+ * GStreamer integration library for Clutter.
+ *
+ * clutter-gst-cpu-convert.h - YUV to RGB conversion on the CPU, for
+ *                             contexts without GLSL support.
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CLUTTER_GST_CPU_CONVERT_H__
+#define __CLUTTER_GST_CPU_CONVERT_H__
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ClutterGstCpuConverter ClutterGstCpuConverter;
+
+ClutterGstCpuConverter *clutter_gst_cpu_converter_new      (void);
+
+void                    clutter_gst_cpu_converter_free     (ClutterGstCpuConverter *converter);
+
+const gchar *           clutter_gst_cpu_converter_get_name (ClutterGstCpuConverter *converter);
+
+gboolean                clutter_gst_cpu_converter_convert  (ClutterGstCpuConverter *converter,
+                                                            const GstVideoFrame    *src,
+                                                            guint8                 *dest,
+                                                            gint                    dest_stride);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_GST_CPU_CONVERT_H__ */
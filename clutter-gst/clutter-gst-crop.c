@@ -75,14 +75,17 @@ clutter_gst_crop_get_preferred_size (ClutterContent *content,
 {
   ClutterGstFrame *frame =
     clutter_gst_content_get_frame (CLUTTER_GST_CONTENT (content));
+  gint frame_width, frame_height;
 
   if (!frame)
     return FALSE;
 
+  clutter_gst_frame_get_display_size (frame, &frame_width, &frame_height);
+
   if (width)
-    *width = frame->resolution.width;
+    *width = frame_width;
   if (height)
-    *height = frame->resolution.height;
+    *height = frame_height;
 
   return TRUE;
 }
@@ -98,18 +101,22 @@ clutter_gst_crop_get_overlay_box (ClutterGstCrop      *self,
   ClutterGstCropPrivate *priv = self->priv;
   ClutterGstBox overlay_input_box;
   ClutterGstBox frame_input_box;
+  gint frame_width, frame_height;
+
+  /* The positions of the overlays are those in the displayed frame */
+  clutter_gst_frame_get_display_size (frame, &frame_width, &frame_height);
 
   /* Clamped frame input */
-  frame_input_box.x1 = priv->input_region.x1 * frame->resolution.width;
-  frame_input_box.y1 = priv->input_region.y1 * frame->resolution.height;
-  frame_input_box.x2 = priv->input_region.x2 * frame->resolution.width;
-  frame_input_box.y2 = priv->input_region.y2 * frame->resolution.height;
+  frame_input_box.x1 = priv->input_region.x1 * frame_width;
+  frame_input_box.y1 = priv->input_region.y1 * frame_height;
+  frame_input_box.x2 = priv->input_region.x2 * frame_width;
+  frame_input_box.y2 = priv->input_region.y2 * frame_height;
 
   /* Clamp overlay box to frame's clamping */
-  overlay_input_box.x1 = MAX (priv->input_region.x1 * frame->resolution.width, overlay->position.x1);
-  overlay_input_box.y1 = MAX (priv->input_region.y1 * frame->resolution.height, overlay->position.y1);
-  overlay_input_box.x2 = MIN (priv->input_region.x2 * frame->resolution.width, overlay->position.x2);
-  overlay_input_box.y2 = MIN (priv->input_region.y2 * frame->resolution.height, overlay->position.y2);
+  overlay_input_box.x1 = MAX (priv->input_region.x1 * frame_width, overlay->position.x1);
+  overlay_input_box.y1 = MAX (priv->input_region.y1 * frame_height, overlay->position.y1);
+  overlay_input_box.x2 = MIN (priv->input_region.x2 * frame_width, overlay->position.x2);
+  overlay_input_box.y2 = MIN (priv->input_region.y2 * frame_height, overlay->position.y2);
 
   /* normalize overlay input */
   input_box->x1 = (overlay_input_box.x1 - overlay->position.x1) / (overlay->position.x2 - overlay->position.x1);
@@ -140,6 +147,7 @@ clutter_gst_crop_paint_content (ClutterContent   *content,
   ClutterGstCropPrivate *priv = self->priv;
   ClutterGstContent *gst_content = CLUTTER_GST_CONTENT (content);
   ClutterGstFrame *frame = clutter_gst_content_get_frame (gst_content);
+  ClutterGstVideoSink *sink = clutter_gst_content_get_sink (gst_content);
   guint8 paint_opacity = clutter_actor_get_paint_opacity (actor);
   ClutterActorBox content_box;
   ClutterGstBox frame_box;
@@ -149,6 +157,10 @@ clutter_gst_crop_paint_content (ClutterContent   *content,
 
   clutter_actor_get_content_box (actor, &content_box);
 
+  if (sink)
+    clutter_gst_video_sink_set_paint_stage (sink,
+                                            CLUTTER_STAGE (clutter_actor_get_stage (actor)));
+
   if (!frame)
     {
       /* No frame to paint, just paint the background color of the
@@ -228,9 +240,11 @@ clutter_gst_crop_paint_content (ClutterContent   *content,
                                   paint_opacity,
                                   paint_opacity,
                                   paint_opacity);
-      if (priv->cull_backface)
-        cogl_pipeline_set_cull_face_mode (frame->pipeline,
-                                          COGL_PIPELINE_CULL_FACE_MODE_BACK);
+      /* The pipeline is shared with the other users of the frame */
+      cogl_pipeline_set_cull_face_mode (frame->pipeline,
+                                        priv->cull_backface ?
+                                        COGL_PIPELINE_CULL_FACE_MODE_BACK :
+                                        COGL_PIPELINE_CULL_FACE_MODE_NONE);
 
       node = clutter_pipeline_node_new (frame->pipeline);
       clutter_paint_node_set_name (node, "CropVideoFrame");
@@ -255,14 +269,29 @@ clutter_gst_crop_paint_content (ClutterContent   *content,
 
       if (overlays)
         {
+          ClutterPaintNode *atlas_node = NULL;
           guint i;
 
+          if (overlays->pipeline)
+            {
+              cogl_pipeline_set_color4ub (overlays->pipeline,
+                                          paint_opacity, paint_opacity,
+                                          paint_opacity, paint_opacity);
+
+              atlas_node = clutter_pipeline_node_new (overlays->pipeline);
+              clutter_paint_node_set_name (atlas_node, "CropVideoOverlays");
+              clutter_paint_node_add_child (root, atlas_node);
+            }
+
           for (i = 0; i < overlays->overlays->len; i++)
             {
               ClutterGstOverlay *overlay =
                 g_ptr_array_index (overlays->overlays, i);
+              const ClutterGstBox *region = &overlay->atlas_region;
               ClutterGstBox overlay_box;
               ClutterGstBox overlay_input_box;
+              gfloat region_width = clutter_gst_box_get_width (region),
+                region_height = clutter_gst_box_get_height (region);
 
               /* overlay outside the visible scope? -> next */
               if (!clutter_gst_crop_get_overlay_box (self,
@@ -274,22 +303,40 @@ clutter_gst_crop_paint_content (ClutterContent   *content,
                                                      overlay))
                 continue;
 
-              cogl_pipeline_set_color4ub (overlay->pipeline,
-                                          paint_opacity, paint_opacity,
-                                          paint_opacity, paint_opacity);
-
-              node = clutter_pipeline_node_new (overlay->pipeline);
-              clutter_paint_node_set_name (node, "CropVideoOverlay");
-
+              /* Overlays that didn't fit in the atlas are painted on
+               * their own */
+              if (overlay->in_atlas)
+                {
+                  if (atlas_node == NULL)
+                    continue;
+
+                  node = clutter_paint_node_ref (atlas_node);
+                }
+              else
+                {
+                  cogl_pipeline_set_color4ub (overlay->pipeline,
+                                              paint_opacity, paint_opacity,
+                                              paint_opacity, paint_opacity);
+
+                  node = clutter_pipeline_node_new (overlay->pipeline);
+                  clutter_paint_node_add_child (root, node);
+                }
+
+              /* The input box is relative to the overlay, the texture
+               * coordinates to the atlas */
               clutter_paint_node_add_texture_rectangle_custom (node,
                                                                overlay_box.x1, overlay_box.y1,
                                                                overlay_box.x2, overlay_box.y2,
-                                                               overlay_input_box.x1, overlay_input_box.y1,
-                                                               overlay_input_box.x2, overlay_input_box.y2);
+                                                               region->x1 + overlay_input_box.x1 * region_width,
+                                                               region->y1 + overlay_input_box.y1 * region_height,
+                                                               region->x1 + overlay_input_box.x2 * region_width,
+                                                               region->y1 + overlay_input_box.y2 * region_height);
 
-              clutter_paint_node_add_child (root, node);
               clutter_paint_node_unref (node);
             }
+
+          if (atlas_node)
+            clutter_paint_node_unref (atlas_node);
         }
     }
 }
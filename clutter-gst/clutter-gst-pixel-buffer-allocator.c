@@ -0,0 +1,839 @@
+/*
+ * Clutter-GStreamer.
+ *
+ * GStreamer integration library for Clutter.
+ *
+ * clutter-gst-pixel-buffer-allocator.c - GstAllocator handing out
+ *                                        memory backed by Cogl pixel
+ *                                        buffers.
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The memory handed out by this allocator lives in a Cogl pixel buffer
+ * (a PBO when the driver supports them) that stays mapped while
+ * upstream elements write into it. When the sink gets such a buffer,
+ * it unmaps the pixel buffer and lets the GL driver pull the pixels
+ * from it into the frame textures, saving the copy into driver owned
+ * memory that cogl_texture_set_data() would do.
+ *
+ * Mapping the pixel buffer right after that would wait for the driver
+ * to be done with the transfer, so uploaded memories are only mapped
+ * back once the next frame gets uploaded, by which time the transfer
+ * is long finished, when someone maps them before that, or at the
+ * latest before their buffer goes back to the pool of the sink, see
+ * clutter-gst-pixel-buffer-pool.c.
+ *
+ * Cogl is not thread safe, so everything touching the pixel buffers is
+ * marshalled to the main context the sink renders from. So that
+ * allocations from streaming threads don't have to wait for it, the
+ * pools of the sink reserve pixel buffers of the size they are
+ * configured with and the main context keeps a stock of them ready.
+ * Allocations finding the stock empty get system memory instead, the
+ * sink accounts for those in its statistics.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "clutter-gst-pixel-buffer-allocator.h"
+
+GST_DEBUG_CATEGORY_STATIC (clutter_gst_pixel_buffer_allocator_debug);
+#define GST_CAT_DEFAULT clutter_gst_pixel_buffer_allocator_debug
+
+typedef struct
+{
+  GstMemory mem;
+
+  CoglPixelBuffer *pbo;
+
+  /* Protects data and map_count against the main thread unmapping the
+   * pixel buffer while it is being uploaded from */
+  GMutex lock;
+  guint8 *data;
+  gint map_count;
+} ClutterGstPixelBufferMemory;
+
+/* Pixel buffer in the stock, mapped and ready to be handed out */
+typedef struct
+{
+  CoglPixelBuffer *pbo;
+  guint8 *data;
+  gsize size;
+} PixelBuffer;
+
+typedef struct
+{
+  ClutterGstPixelBufferAllocator *allocator;
+  GstMemory *mem;
+
+  gboolean done;
+  gboolean cancelled;
+} MapRequest;
+
+#define REQUEST_TIMEOUT (100 * G_TIME_SPAN_MILLISECOND)
+
+G_DEFINE_TYPE (ClutterGstPixelBufferAllocator,
+               clutter_gst_pixel_buffer_allocator,
+               GST_TYPE_ALLOCATOR);
+
+static guint8 *
+map_pixel_buffer (CoglPixelBuffer *pbo)
+{
+  return cogl_buffer_map (COGL_BUFFER (pbo),
+                          COGL_BUFFER_ACCESS_READ_WRITE,
+                          0);
+}
+
+/* Runs on the main context */
+static void
+create_pixel_buffer (ClutterGstPixelBufferAllocator *self,
+                     gsize                           size,
+                     CoglPixelBuffer               **pbo_out,
+                     guint8                        **data_out)
+{
+  CoglPixelBuffer *pbo;
+  guint8 *data;
+
+  *pbo_out = NULL;
+  *data_out = NULL;
+
+  pbo = cogl_pixel_buffer_new (self->ctx, size, NULL);
+  if (!pbo)
+    return;
+
+  cogl_buffer_set_update_hint (COGL_BUFFER (pbo),
+                               COGL_BUFFER_UPDATE_HINT_STREAM);
+
+  data = map_pixel_buffer (pbo);
+  if (!data)
+    {
+      cogl_object_unref (pbo);
+      return;
+    }
+
+  *pbo_out = pbo;
+  *data_out = data;
+}
+
+static void
+destroy_pixel_buffer (CoglPixelBuffer *pbo)
+{
+  if (cogl_buffer_is_mapped (COGL_BUFFER (pbo)))
+    cogl_buffer_unmap (COGL_BUFFER (pbo));
+  cogl_object_unref (pbo);
+}
+
+static gboolean
+destroy_pixel_buffer_cb (gpointer user_data)
+{
+  destroy_pixel_buffer (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Unlike g_main_context_invoke(), never runs @func from the calling
+ * thread, which might be holding our lock or not be allowed to use
+ * Cogl, even if nobody is iterating the context */
+static void
+invoke_on_context (ClutterGstPixelBufferAllocator *self,
+                   gint                            priority,
+                   GSourceFunc                     func,
+                   gpointer                        data,
+                   GDestroyNotify                  notify)
+{
+  GSource *source;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, priority);
+  g_source_set_callback (source, func, data, notify);
+  g_source_attach (source, self->context);
+  g_source_unref (source);
+}
+
+/* Number of pixel buffers of the reserved size in the stock, called
+ * with the lock held */
+static guint
+count_stock (ClutterGstPixelBufferAllocator *self)
+{
+  GList *l;
+  guint count = 0;
+
+  for (l = self->stock.head; l; l = l->next)
+    if (((PixelBuffer *) l->data)->size == self->reserve_size)
+      count++;
+
+  return count;
+}
+
+/* Runs on the main context. Creates the pixel buffers missing from the
+ * stock and drops the ones that are not of the reserved size. */
+static void
+refill_stock (ClutterGstPixelBufferAllocator *self)
+{
+  while (TRUE)
+    {
+      PixelBuffer *buffer = NULL;
+      GList *l;
+      gsize size;
+
+      g_mutex_lock (&self->lock);
+      for (l = self->stock.head; l; l = l->next)
+        if (((PixelBuffer *) l->data)->size != self->reserve_size)
+          break;
+
+      if (l)
+        {
+          buffer = l->data;
+          g_queue_delete_link (&self->stock, l);
+          g_mutex_unlock (&self->lock);
+
+          destroy_pixel_buffer (buffer->pbo);
+          g_slice_free (PixelBuffer, buffer);
+          continue;
+        }
+
+      if (count_stock (self) >= self->reserve_count)
+        {
+          self->refill_pending = FALSE;
+          g_mutex_unlock (&self->lock);
+          return;
+        }
+
+      size = self->reserve_size;
+      g_mutex_unlock (&self->lock);
+
+      buffer = g_slice_new (PixelBuffer);
+      buffer->size = size;
+      create_pixel_buffer (self, size, &buffer->pbo, &buffer->data);
+
+      g_mutex_lock (&self->lock);
+      if (buffer->pbo == NULL)
+        {
+          GST_WARNING_OBJECT (self, "failed to create a pixel buffer of %"
+                              G_GSIZE_FORMAT " bytes", size);
+          self->refill_pending = FALSE;
+          g_cond_broadcast (&self->cond);
+          g_mutex_unlock (&self->lock);
+          g_slice_free (PixelBuffer, buffer);
+          return;
+        }
+
+      g_queue_push_tail (&self->stock, buffer);
+      g_cond_broadcast (&self->cond);
+      g_mutex_unlock (&self->lock);
+    }
+}
+
+static gboolean
+refill_stock_cb (gpointer user_data)
+{
+  refill_stock (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called with the lock held */
+static void
+schedule_refill (ClutterGstPixelBufferAllocator *self)
+{
+  if (self->refill_pending || self->flushing)
+    return;
+
+  self->refill_pending = TRUE;
+  invoke_on_context (self, G_PRIORITY_DEFAULT, refill_stock_cb,
+                     gst_object_ref (self), gst_object_unref);
+}
+
+/* Hands out a pixel buffer of @size bytes from the stock, or a new one
+ * if called from the main context */
+static gboolean
+take_pixel_buffer (ClutterGstPixelBufferAllocator *self,
+                   gsize                           size,
+                   CoglPixelBuffer               **pbo,
+                   guint8                        **data)
+{
+  PixelBuffer *buffer = NULL;
+  GList *l;
+
+  g_mutex_lock (&self->lock);
+  for (l = self->stock.head; l; l = l->next)
+    if (((PixelBuffer *) l->data)->size == size)
+      break;
+
+  if (l)
+    {
+      buffer = l->data;
+      g_queue_delete_link (&self->stock, l);
+    }
+
+  if (size == self->reserve_size && count_stock (self) < self->reserve_count)
+    schedule_refill (self);
+  g_mutex_unlock (&self->lock);
+
+  if (buffer)
+    {
+      *pbo = buffer->pbo;
+      *data = buffer->data;
+      g_slice_free (PixelBuffer, buffer);
+      return TRUE;
+    }
+
+  if (g_main_context_is_owner (self->context))
+    {
+      create_pixel_buffer (self, size, pbo, data);
+      return *pbo != NULL;
+    }
+
+  return FALSE;
+}
+
+/* Maps back the pixel buffer of a memory that was uploaded from. Runs
+ * on the main context, with the allocator lock held. */
+static void
+map_uploaded_memory (ClutterGstPixelBufferAllocator *self,
+                     ClutterGstPixelBufferMemory    *mem)
+{
+  g_queue_remove (&self->uploaded, mem);
+
+  g_mutex_lock (&mem->lock);
+  if (mem->data == NULL)
+    {
+      mem->data = map_pixel_buffer (mem->pbo);
+      if (!mem->data)
+        GST_WARNING_OBJECT (self, "failed to map pixel buffer %p back",
+                            mem->pbo);
+    }
+  g_mutex_unlock (&mem->lock);
+}
+
+static gboolean
+map_request_cb (gpointer user_data)
+{
+  MapRequest *req = user_data;
+  ClutterGstPixelBufferAllocator *self = req->allocator;
+
+  g_mutex_lock (&self->lock);
+  map_uploaded_memory (self, (ClutterGstPixelBufferMemory *) req->mem);
+  if (!req->cancelled)
+    {
+      req->done = TRUE;
+      g_cond_broadcast (&self->cond);
+      g_mutex_unlock (&self->lock);
+      return G_SOURCE_REMOVE;
+    }
+  g_mutex_unlock (&self->lock);
+
+  /* The streaming thread gave up on us, the memory might go away with
+   * this last reference */
+  gst_memory_unref (req->mem);
+  gst_object_unref (self);
+  g_slice_free (MapRequest, req);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Someone needs a memory that was uploaded from before the next frame
+ * got it mapped back, have the main context do it now. There is no
+ * giving up on a busy main context, upstream would take the failed
+ * map for a fatal error; only flushing, when the main context might be
+ * waiting for the streaming threads, makes the request fail. */
+static gboolean
+request_map (ClutterGstPixelBufferAllocator *self,
+             ClutterGstPixelBufferMemory    *mem)
+{
+  MapRequest *req;
+  gboolean ret = FALSE;
+
+  if (g_main_context_is_owner (self->context))
+    {
+      g_mutex_lock (&self->lock);
+      map_uploaded_memory (self, mem);
+      g_mutex_unlock (&self->lock);
+      return TRUE;
+    }
+
+  req = g_slice_new0 (MapRequest);
+  req->allocator = gst_object_ref (self);
+  req->mem = gst_memory_ref (GST_MEMORY_CAST (mem));
+
+  g_mutex_lock (&self->lock);
+  if (self->flushing)
+    {
+      g_mutex_unlock (&self->lock);
+      gst_memory_unref (req->mem);
+      gst_object_unref (self);
+      g_slice_free (MapRequest, req);
+      return FALSE;
+    }
+
+  invoke_on_context (self, G_PRIORITY_HIGH, map_request_cb, req, NULL);
+
+  while (!req->done && !self->flushing)
+    g_cond_wait (&self->cond, &self->lock);
+
+  if (req->done)
+    {
+      ret = TRUE;
+      g_mutex_unlock (&self->lock);
+
+      gst_memory_unref (req->mem);
+      gst_object_unref (self);
+      g_slice_free (MapRequest, req);
+    }
+  else
+    {
+      /* The request will be freed from the main context */
+      GST_DEBUG_OBJECT (self, "flushing, abandoning pixel buffer map request");
+      req->cancelled = TRUE;
+      g_mutex_unlock (&self->lock);
+    }
+
+  return ret;
+}
+
+/**/
+
+static gpointer
+clutter_gst_pixel_buffer_mem_map (GstMemory  *gmem,
+                                  gsize       maxsize,
+                                  GstMapFlags flags)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (gmem->allocator);
+  ClutterGstPixelBufferMemory *mem = (ClutterGstPixelBufferMemory *) gmem;
+  gpointer data;
+
+  g_mutex_lock (&mem->lock);
+  if (mem->data == NULL)
+    {
+      g_mutex_unlock (&mem->lock);
+      if (!request_map (self, mem))
+        return NULL;
+      g_mutex_lock (&mem->lock);
+    }
+
+  data = mem->data;
+  if (data)
+    mem->map_count++;
+  g_mutex_unlock (&mem->lock);
+
+  return data;
+}
+
+static void
+clutter_gst_pixel_buffer_mem_unmap (GstMemory *gmem)
+{
+  ClutterGstPixelBufferMemory *mem = (ClutterGstPixelBufferMemory *) gmem;
+
+  g_mutex_lock (&mem->lock);
+  mem->map_count--;
+  g_mutex_unlock (&mem->lock);
+}
+
+static GstMemory *
+clutter_gst_pixel_buffer_mem_copy (GstMemory *gmem,
+                                   gssize     offset,
+                                   gssize     size)
+{
+  GstMemory *copy;
+  GstMapInfo src, dest;
+
+  if (size == -1)
+    size = gmem->size > offset ? gmem->size - offset : 0;
+
+  if (!gst_memory_map (gmem, &src, GST_MAP_READ))
+    return NULL;
+
+  copy = gst_allocator_alloc (NULL, size, NULL);
+  if (!gst_memory_map (copy, &dest, GST_MAP_WRITE))
+    {
+      gst_memory_unmap (gmem, &src);
+      gst_memory_unref (copy);
+      return NULL;
+    }
+
+  memcpy (dest.data, src.data + offset, size);
+
+  gst_memory_unmap (copy, &dest);
+  gst_memory_unmap (gmem, &src);
+
+  return copy;
+}
+
+static GstMemory *
+clutter_gst_pixel_buffer_mem_share (GstMemory *gmem,
+                                    gssize     offset,
+                                    gssize     size)
+{
+  return NULL;
+}
+
+static gboolean
+clutter_gst_pixel_buffer_mem_is_span (GstMemory *mem1,
+                                      GstMemory *mem2,
+                                      gsize     *offset)
+{
+  return FALSE;
+}
+
+/**/
+
+static GstMemory *
+clutter_gst_pixel_buffer_allocator_alloc (GstAllocator        *allocator,
+                                          gsize                size,
+                                          GstAllocationParams *params)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (allocator);
+  ClutterGstPixelBufferMemory *mem;
+  CoglPixelBuffer *pbo = NULL;
+  guint8 *data = NULL;
+  gsize maxsize;
+
+  maxsize = size + params->prefix + params->padding;
+
+  if (!take_pixel_buffer (self, maxsize, &pbo, &data))
+    {
+      /* Hand out system memory instead, the sink will copy it into the
+       * textures as it would have done without our pool. The sink counts
+       * those in its statistics. */
+      GST_DEBUG_OBJECT (self, "no pixel buffer of %" G_GSIZE_FORMAT
+                        " bytes ready, using system memory", maxsize);
+      return gst_allocator_alloc (NULL, size, params);
+    }
+
+  mem = g_slice_new0 (ClutterGstPixelBufferMemory);
+  gst_memory_init (GST_MEMORY_CAST (mem),
+                   params->flags | GST_MEMORY_FLAG_NO_SHARE,
+                   allocator, NULL, maxsize, params->align,
+                   params->prefix, size);
+
+  g_mutex_init (&mem->lock);
+  mem->pbo = pbo;
+  mem->data = data;
+
+  GST_LOG_OBJECT (self, "allocated pixel buffer memory %p of %"
+                  G_GSIZE_FORMAT " bytes", mem, maxsize);
+
+  return GST_MEMORY_CAST (mem);
+}
+
+static void
+clutter_gst_pixel_buffer_allocator_free (GstAllocator *allocator,
+                                         GstMemory    *gmem)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (allocator);
+  ClutterGstPixelBufferMemory *mem = (ClutterGstPixelBufferMemory *) gmem;
+
+  g_mutex_lock (&self->lock);
+  g_queue_remove (&self->uploaded, mem);
+
+  /* Kept for the next allocations if it is still mapped */
+  if (mem->data != NULL && gmem->maxsize == self->reserve_size &&
+      count_stock (self) < self->reserve_count)
+    {
+      PixelBuffer *buffer = g_slice_new (PixelBuffer);
+
+      buffer->pbo = mem->pbo;
+      buffer->data = mem->data;
+      buffer->size = gmem->maxsize;
+      g_queue_push_tail (&self->stock, buffer);
+      g_cond_broadcast (&self->cond);
+      mem->pbo = NULL;
+    }
+  g_mutex_unlock (&self->lock);
+
+  if (mem->pbo != NULL)
+    {
+      if (g_main_context_is_owner (self->context))
+        destroy_pixel_buffer (mem->pbo);
+      else
+        invoke_on_context (self, G_PRIORITY_DEFAULT,
+                           destroy_pixel_buffer_cb, mem->pbo, NULL);
+    }
+
+  g_mutex_clear (&mem->lock);
+  g_slice_free (ClutterGstPixelBufferMemory, mem);
+}
+
+static void
+clutter_gst_pixel_buffer_allocator_finalize (GObject *object)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (object);
+  PixelBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&self->stock)))
+    {
+      if (g_main_context_is_owner (self->context))
+        destroy_pixel_buffer (buffer->pbo);
+      else
+        invoke_on_context (self, G_PRIORITY_DEFAULT,
+                           destroy_pixel_buffer_cb, buffer->pbo, NULL);
+      g_slice_free (PixelBuffer, buffer);
+    }
+
+  cogl_object_unref (self->ctx);
+  g_main_context_unref (self->context);
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (clutter_gst_pixel_buffer_allocator_parent_class)->finalize (object);
+}
+
+static void
+clutter_gst_pixel_buffer_allocator_class_init (ClutterGstPixelBufferAllocatorClass *klass)
+{
+  GObjectClass *go_class = G_OBJECT_CLASS (klass);
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  go_class->finalize = clutter_gst_pixel_buffer_allocator_finalize;
+
+  allocator_class->alloc = clutter_gst_pixel_buffer_allocator_alloc;
+  allocator_class->free = clutter_gst_pixel_buffer_allocator_free;
+
+  GST_DEBUG_CATEGORY_INIT (clutter_gst_pixel_buffer_allocator_debug,
+                           "cluttergstpixelbufferallocator",
+                           0,
+                           "clutter gst pixel buffer allocator");
+}
+
+static void
+clutter_gst_pixel_buffer_allocator_init (ClutterGstPixelBufferAllocator *self)
+{
+  GstAllocator *allocator = GST_ALLOCATOR_CAST (self);
+
+  allocator->mem_type = CLUTTER_GST_PIXEL_BUFFER_MEMORY_TYPE;
+  allocator->mem_map = clutter_gst_pixel_buffer_mem_map;
+  allocator->mem_unmap = clutter_gst_pixel_buffer_mem_unmap;
+  allocator->mem_copy = clutter_gst_pixel_buffer_mem_copy;
+  allocator->mem_share = clutter_gst_pixel_buffer_mem_share;
+  allocator->mem_is_span = clutter_gst_pixel_buffer_mem_is_span;
+
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->uploaded);
+  g_queue_init (&self->stock);
+}
+
+GstAllocator *
+clutter_gst_pixel_buffer_allocator_new (CoglContext  *ctx,
+                                        GMainContext *context)
+{
+  ClutterGstPixelBufferAllocator *self;
+
+  self = g_object_new (CLUTTER_GST_TYPE_PIXEL_BUFFER_ALLOCATOR, NULL);
+  self->ctx = cogl_object_ref (ctx);
+  self->context = g_main_context_ref (context ? context :
+                                      g_main_context_default ());
+
+  return GST_ALLOCATOR_CAST (self);
+}
+
+/* Makes sure @count pixel buffers of @size bytes are ready to be handed
+ * out without going through the main context, waiting for it to create
+ * them if needed. From then on the main context keeps that many in
+ * stock, pixel buffers of other sizes are dropped. Returns FALSE if
+ * the main context didn't get to it in time. */
+gboolean
+clutter_gst_pixel_buffer_allocator_reserve (GstAllocator *allocator,
+                                            gsize         size,
+                                            guint         count)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (allocator);
+  gint64 end_time;
+  gboolean ret;
+
+  g_mutex_lock (&self->lock);
+  if (self->reserve_size != size)
+    {
+      self->reserve_size = size;
+      self->reserve_count = count;
+    }
+  else
+    self->reserve_count = MAX (self->reserve_count, count);
+
+  if (g_main_context_is_owner (self->context))
+    {
+      g_mutex_unlock (&self->lock);
+      refill_stock (self);
+      g_mutex_lock (&self->lock);
+    }
+  else if (count_stock (self) < count)
+    {
+      schedule_refill (self);
+
+      /* The main context might itself be blocked waiting for the
+       * pipeline to preroll, don't wait for it forever */
+      end_time = g_get_monotonic_time () + REQUEST_TIMEOUT;
+      while (count_stock (self) < count && self->refill_pending &&
+             !self->flushing)
+        if (!g_cond_wait_until (&self->cond, &self->lock, end_time))
+          break;
+    }
+
+  ret = count_stock (self) >= count;
+  g_mutex_unlock (&self->lock);
+
+  if (!ret)
+    GST_WARNING_OBJECT (self, "could not reserve %u pixel buffers of %"
+                        G_GSIZE_FORMAT " bytes", count, size);
+
+  return ret;
+}
+
+/* While flushing, requests coming from streaming threads fail instead
+ * of waiting for the main context, which might itself be waiting for
+ * those threads to stop. */
+void
+clutter_gst_pixel_buffer_allocator_set_flushing (GstAllocator *allocator,
+                                                 gboolean      flushing)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (allocator);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = flushing;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+}
+
+gboolean
+clutter_gst_is_pixel_buffer_memory (GstMemory *mem)
+{
+  return mem != NULL && mem->allocator != NULL &&
+    g_type_check_instance_is_a ((GTypeInstance *) mem->allocator,
+                                CLUTTER_GST_TYPE_PIXEL_BUFFER_ALLOCATOR);
+}
+
+/* Maps back the pixel buffers uploaded from since the last call. Must
+ * be called from the main context, before uploading the next frame. */
+void
+clutter_gst_pixel_buffer_allocator_map_uploaded (GstAllocator *allocator)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (allocator);
+
+  g_mutex_lock (&self->lock);
+  while (!g_queue_is_empty (&self->uploaded))
+    map_uploaded_memory (self, g_queue_peek_head (&self->uploaded));
+  g_mutex_unlock (&self->lock);
+}
+
+/* Unmaps the pixel buffer so it can be used as the source of a texture
+ * upload, @data is set to the address the memory was mapped at so that
+ * callers can turn pointers into the mapped data into offsets in the
+ * pixel buffer. Returns NULL if the memory is mapped by someone else,
+ * in which case the caller has to copy the data instead. Must be called
+ * from the main context, and followed by
+ * clutter_gst_pixel_buffer_memory_end_upload() on success. The pixel
+ * buffer stays unmapped until the next call to
+ * clutter_gst_pixel_buffer_allocator_map_uploaded(). */
+CoglPixelBuffer *
+clutter_gst_pixel_buffer_memory_begin_upload (GstMemory  *gmem,
+                                              guint8    **data)
+{
+  ClutterGstPixelBufferMemory *mem = (ClutterGstPixelBufferMemory *) gmem;
+
+  g_return_val_if_fail (clutter_gst_is_pixel_buffer_memory (gmem), NULL);
+
+  g_mutex_lock (&mem->lock);
+  if (mem->map_count > 0 || mem->data == NULL)
+    {
+      g_mutex_unlock (&mem->lock);
+      return NULL;
+    }
+
+  *data = mem->data;
+  mem->data = NULL;
+  cogl_buffer_unmap (COGL_BUFFER (mem->pbo));
+
+  /* The lock is kept until the upload is done */
+  return mem->pbo;
+}
+
+void
+clutter_gst_pixel_buffer_memory_end_upload (GstMemory *gmem)
+{
+  ClutterGstPixelBufferAllocator *self =
+    CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (gmem->allocator);
+  ClutterGstPixelBufferMemory *mem = (ClutterGstPixelBufferMemory *) gmem;
+
+  g_mutex_unlock (&mem->lock);
+
+  g_mutex_lock (&self->lock);
+  g_queue_push_tail (&self->uploaded, mem);
+  g_mutex_unlock (&self->lock);
+}
+
+/* Whether the pixel buffers of all the memories of @buffer are mapped,
+ * as they have to be before upstream gets @buffer back */
+gboolean
+clutter_gst_pixel_buffer_is_mapped (GstBuffer *buffer)
+{
+  guint i, n_memory = gst_buffer_n_memory (buffer);
+
+  for (i = 0; i < n_memory; i++)
+    {
+      GstMemory *gmem = gst_buffer_peek_memory (buffer, i);
+      ClutterGstPixelBufferMemory *mem = (ClutterGstPixelBufferMemory *) gmem;
+      gboolean mapped;
+
+      if (!clutter_gst_is_pixel_buffer_memory (gmem))
+        continue;
+
+      g_mutex_lock (&mem->lock);
+      mapped = mem->data != NULL;
+      g_mutex_unlock (&mem->lock);
+
+      if (!mapped)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Maps back the pixel buffers of the memories of @buffer that were
+ * uploaded from. Must be called from the main context. */
+void
+clutter_gst_pixel_buffer_map_back (GstBuffer *buffer)
+{
+  guint i, n_memory = gst_buffer_n_memory (buffer);
+
+  for (i = 0; i < n_memory; i++)
+    {
+      GstMemory *gmem = gst_buffer_peek_memory (buffer, i);
+      ClutterGstPixelBufferAllocator *self;
+
+      if (!clutter_gst_is_pixel_buffer_memory (gmem))
+        continue;
+
+      self = CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (gmem->allocator);
+
+      g_mutex_lock (&self->lock);
+      map_uploaded_memory (self, (ClutterGstPixelBufferMemory *) gmem);
+      g_mutex_unlock (&self->lock);
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Clutter-GStreamer.
+ *
+ * GStreamer integration library for Clutter.
+ *
+ * clutter-gst-pixel-buffer-allocator.h - GstAllocator handing out
+ *                                        memory backed by Cogl pixel
+ *                                        buffers.
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR_H__
+#define __CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR_H__
+
+#include <cogl/cogl.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define CLUTTER_GST_TYPE_PIXEL_BUFFER_ALLOCATOR \
+  (clutter_gst_pixel_buffer_allocator_get_type())
+
+#define CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                              CLUTTER_GST_TYPE_PIXEL_BUFFER_ALLOCATOR, \
+                              ClutterGstPixelBufferAllocator))
+
+#define CLUTTER_GST_IS_PIXEL_BUFFER_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                              CLUTTER_GST_TYPE_PIXEL_BUFFER_ALLOCATOR))
+
+#define CLUTTER_GST_PIXEL_BUFFER_MEMORY_TYPE "ClutterGstPixelBuffer"
+
+typedef struct _ClutterGstPixelBufferAllocator ClutterGstPixelBufferAllocator;
+typedef struct _ClutterGstPixelBufferAllocatorClass ClutterGstPixelBufferAllocatorClass;
+
+struct _ClutterGstPixelBufferAllocator
+{
+  GstAllocator parent;
+
+  CoglContext *ctx;
+  GMainContext *context;
+
+  GMutex lock;
+  GCond cond;
+  gboolean flushing;
+  /* Memories waiting to be mapped back after an upload */
+  GQueue uploaded;
+
+  /* Pixel buffers ready to be handed out */
+  GQueue stock;
+  gsize reserve_size;
+  guint reserve_count;
+  gboolean refill_pending;
+};
+
+struct _ClutterGstPixelBufferAllocatorClass
+{
+  GstAllocatorClass parent_class;
+};
+
+GType            clutter_gst_pixel_buffer_allocator_get_type      (void);
+
+GstAllocator *   clutter_gst_pixel_buffer_allocator_new           (CoglContext  *ctx,
+                                                                   GMainContext *context);
+
+gboolean         clutter_gst_pixel_buffer_allocator_reserve       (GstAllocator *allocator,
+                                                                   gsize         size,
+                                                                   guint         count);
+
+void             clutter_gst_pixel_buffer_allocator_set_flushing  (GstAllocator *allocator,
+                                                                   gboolean      flushing);
+
+void             clutter_gst_pixel_buffer_allocator_map_uploaded  (GstAllocator *allocator);
+
+gboolean         clutter_gst_is_pixel_buffer_memory               (GstMemory    *mem);
+
+gboolean         clutter_gst_pixel_buffer_is_mapped               (GstBuffer    *buffer);
+
+void             clutter_gst_pixel_buffer_map_back                (GstBuffer    *buffer);
+
+CoglPixelBuffer *clutter_gst_pixel_buffer_memory_begin_upload     (GstMemory    *mem,
+                                                                   guint8      **data);
+
+void             clutter_gst_pixel_buffer_memory_end_upload       (GstMemory    *mem);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR_H__ */
@@ -0,0 +1,231 @@
+/*
+ * Clutter-GStreamer.
+ *
+ * GStreamer integration library for Clutter.
+ *
+ * clutter-gst-pixel-buffer-pool.c - GstBufferPool handing out video
+ *                                   frames backed by Cogl pixel
+ *                                   buffers.
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A GstVideoBufferPool that has the pixel buffer allocator it is
+ * configured with reserve pixel buffers of the size the pool actually
+ * allocates. That size is only known once upstream is done with the
+ * configuration: decoders asking for GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT
+ * get frames padded past the size given by the caps.
+ *
+ * The sink unmaps the pixel buffers it uploads frames from. The pool
+ * makes sure they are mapped back before their buffer is handed out
+ * again: a streaming thread mapping them would otherwise have to wait
+ * for the main context to do it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "clutter-gst-pixel-buffer-pool.h"
+#include "clutter-gst-pixel-buffer-allocator.h"
+
+GST_DEBUG_CATEGORY_STATIC (clutter_gst_pixel_buffer_pool_debug);
+#define GST_CAT_DEFAULT clutter_gst_pixel_buffer_pool_debug
+
+typedef struct
+{
+  GstBufferPool *pool;
+  GstBuffer *buffer;
+} ReleaseRequest;
+
+G_DEFINE_TYPE (ClutterGstPixelBufferPool,
+               clutter_gst_pixel_buffer_pool,
+               GST_TYPE_VIDEO_BUFFER_POOL);
+
+static gboolean
+clutter_gst_pixel_buffer_pool_set_config (GstBufferPool *pool,
+                                          GstStructure  *config)
+{
+  ClutterGstPixelBufferPool *self = CLUTTER_GST_PIXEL_BUFFER_POOL (pool);
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstCaps *caps;
+  guint size, min_buffers, max_buffers, count;
+  gboolean reserved = FALSE;
+
+  if (!GST_BUFFER_POOL_CLASS (clutter_gst_pixel_buffer_pool_parent_class)->set_config (pool, config))
+    return FALSE;
+
+  /* The parent stored the size it allocates, aligned frames included */
+  config = gst_buffer_pool_get_config (pool);
+  if (gst_buffer_pool_config_get_params (config, &caps, &size,
+                                         &min_buffers, &max_buffers) &&
+      gst_buffer_pool_config_get_allocator (config, &allocator, &params) &&
+      allocator != NULL &&
+      CLUTTER_GST_IS_PIXEL_BUFFER_ALLOCATOR (allocator))
+    {
+      count = min_buffers + self->spares;
+      if (max_buffers != 0)
+        count = MIN (count, max_buffers);
+
+      GST_DEBUG_OBJECT (self, "reserving %u pixel buffers of %u bytes",
+                        count, size);
+
+      reserved =
+        clutter_gst_pixel_buffer_allocator_reserve (allocator,
+                                                    size + params.prefix +
+                                                    params.padding,
+                                                    count);
+    }
+  else
+    allocator = NULL;
+
+  gst_object_replace ((GstObject **) &self->allocator,
+                      (GstObject *) allocator);
+  gst_structure_free (config);
+
+  g_atomic_int_set (&self->reserved, reserved);
+
+  return TRUE;
+}
+
+/* Hands @buffer back to the pool, or frees it if the pool got
+ * deactivated while the buffer was being mapped back */
+static void
+release_mapped_buffer (GstBufferPool *pool,
+                       GstBuffer     *buffer)
+{
+  GstBufferPoolClass *parent_class =
+    GST_BUFFER_POOL_CLASS (clutter_gst_pixel_buffer_pool_parent_class);
+
+  if (gst_buffer_pool_is_active (pool))
+    parent_class->release_buffer (pool, buffer);
+  else
+    parent_class->free_buffer (pool, buffer);
+}
+
+static gboolean
+release_request_cb (gpointer user_data)
+{
+  ReleaseRequest *req = user_data;
+
+  clutter_gst_pixel_buffer_map_back (req->buffer);
+  release_mapped_buffer (req->pool, req->buffer);
+
+  gst_object_unref (req->pool);
+  g_slice_free (ReleaseRequest, req);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+clutter_gst_pixel_buffer_pool_release_buffer (GstBufferPool *pool,
+                                              GstBuffer     *buffer)
+{
+  ClutterGstPixelBufferPool *self = CLUTTER_GST_PIXEL_BUFFER_POOL (pool);
+  GstBufferPoolClass *parent_class =
+    GST_BUFFER_POOL_CLASS (clutter_gst_pixel_buffer_pool_parent_class);
+  ClutterGstPixelBufferAllocator *allocator;
+  ReleaseRequest *req;
+  GSource *source;
+
+  if (self->allocator == NULL || clutter_gst_pixel_buffer_is_mapped (buffer))
+    {
+      parent_class->release_buffer (pool, buffer);
+      return;
+    }
+
+  allocator = CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (self->allocator);
+
+  if (g_main_context_is_owner (allocator->context))
+    {
+      clutter_gst_pixel_buffer_map_back (buffer);
+      parent_class->release_buffer (pool, buffer);
+      return;
+    }
+
+  /* Only the main context can map the pixel buffers, the buffer joins
+   * the pool once it did */
+  GST_LOG_OBJECT (self, "mapping back buffer %p before releasing it", buffer);
+
+  req = g_slice_new (ReleaseRequest);
+  req->pool = gst_object_ref (pool);
+  req->buffer = buffer;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_callback (source, release_request_cb, req, NULL);
+  g_source_attach (source, allocator->context);
+  g_source_unref (source);
+}
+
+static void
+clutter_gst_pixel_buffer_pool_finalize (GObject *object)
+{
+  ClutterGstPixelBufferPool *self = CLUTTER_GST_PIXEL_BUFFER_POOL (object);
+
+  if (self->allocator)
+    gst_object_unref (self->allocator);
+
+  G_OBJECT_CLASS (clutter_gst_pixel_buffer_pool_parent_class)->finalize (object);
+}
+
+static void
+clutter_gst_pixel_buffer_pool_class_init (ClutterGstPixelBufferPoolClass *klass)
+{
+  GObjectClass *go_class = G_OBJECT_CLASS (klass);
+  GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS (klass);
+
+  go_class->finalize = clutter_gst_pixel_buffer_pool_finalize;
+
+  pool_class->set_config = clutter_gst_pixel_buffer_pool_set_config;
+  pool_class->release_buffer = clutter_gst_pixel_buffer_pool_release_buffer;
+
+  GST_DEBUG_CATEGORY_INIT (clutter_gst_pixel_buffer_pool_debug,
+                           "cluttergstpixelbufferpool",
+                           0,
+                           "clutter gst pixel buffer pool");
+}
+
+static void
+clutter_gst_pixel_buffer_pool_init (ClutterGstPixelBufferPool *self)
+{
+}
+
+GstBufferPool *
+clutter_gst_pixel_buffer_pool_new (guint spares)
+{
+  ClutterGstPixelBufferPool *self;
+
+  self = g_object_new (CLUTTER_GST_TYPE_PIXEL_BUFFER_POOL, NULL);
+  self->spares = spares;
+
+  return GST_BUFFER_POOL_CAST (self);
+}
+
+/* Whether the allocator could reserve the pixel buffers needed by the
+ * last configuration of @pool, without which it would mostly hand out
+ * system memory */
+gboolean
+clutter_gst_pixel_buffer_pool_is_reserved (GstBufferPool *pool)
+{
+  g_return_val_if_fail (CLUTTER_GST_IS_PIXEL_BUFFER_POOL (pool), FALSE);
+
+  return g_atomic_int_get (&CLUTTER_GST_PIXEL_BUFFER_POOL (pool)->reserved);
+}
@@ -0,0 +1,78 @@
+/*
+ * Clutter-GStreamer.
+ *
+ * GStreamer integration library for Clutter.
+ *
+ * clutter-gst-pixel-buffer-pool.h - GstBufferPool handing out video
+ *                                   frames backed by Cogl pixel
+ *                                   buffers.
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CLUTTER_GST_PIXEL_BUFFER_POOL_H__
+#define __CLUTTER_GST_PIXEL_BUFFER_POOL_H__
+
+#include <gst/gst.h>
+#include <gst/video/gstvideopool.h>
+
+G_BEGIN_DECLS
+
+#define CLUTTER_GST_TYPE_PIXEL_BUFFER_POOL \
+  (clutter_gst_pixel_buffer_pool_get_type())
+
+#define CLUTTER_GST_PIXEL_BUFFER_POOL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                              CLUTTER_GST_TYPE_PIXEL_BUFFER_POOL, \
+                              ClutterGstPixelBufferPool))
+
+#define CLUTTER_GST_IS_PIXEL_BUFFER_POOL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                              CLUTTER_GST_TYPE_PIXEL_BUFFER_POOL))
+
+typedef struct _ClutterGstPixelBufferPool ClutterGstPixelBufferPool;
+typedef struct _ClutterGstPixelBufferPoolClass ClutterGstPixelBufferPoolClass;
+
+struct _ClutterGstPixelBufferPool
+{
+  GstVideoBufferPool parent;
+
+  /* Pixel buffer allocator of the last configuration, if any */
+  GstAllocator *allocator;
+  /* Pixel buffers reserved on top of the minimum number of buffers of
+   * the configuration */
+  guint spares;
+  /* Whether the pixel buffers could be reserved for the last
+   * configuration */
+  gboolean reserved;
+};
+
+struct _ClutterGstPixelBufferPoolClass
+{
+  GstVideoBufferPoolClass parent_class;
+};
+
+GType            clutter_gst_pixel_buffer_pool_get_type      (void);
+
+GstBufferPool *  clutter_gst_pixel_buffer_pool_new           (guint          spares);
+
+gboolean         clutter_gst_pixel_buffer_pool_is_reserved   (GstBufferPool *pool);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_GST_PIXEL_BUFFER_POOL_H__ */
@@ -94,7 +94,8 @@ enum
   PROP_AUDIO_STREAM,
   PROP_SUBTITLE_TRACKS,
   PROP_SUBTITLE_TRACK,
-  PROP_IN_SEEK
+  PROP_IN_SEEK,
+  PROP_MAX_FPS
 };
 
 enum
@@ -1580,6 +1581,10 @@ clutter_gst_playback_get_property (GObject    *object,
       g_value_set_boolean (value, priv->in_seek);
       break;
 
+    case PROP_MAX_FPS:
+      g_value_set_double (value, clutter_gst_playback_get_max_fps (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -1639,6 +1644,10 @@ clutter_gst_playback_set_property (GObject      *object,
                                                g_value_get_int (value));
       break;
 
+    case PROP_MAX_FPS:
+      clutter_gst_playback_set_max_fps (self, g_value_get_double (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -1682,7 +1691,7 @@ clutter_gst_playback_dispose (GObject *object)
 
   if (priv->current_frame)
     {
-      g_boxed_free (CLUTTER_GST_TYPE_FRAME, priv->current_frame);
+      clutter_gst_frame_unref (priv->current_frame);
       priv->current_frame = NULL;
     }
 
@@ -1901,6 +1910,22 @@ clutter_gst_playback_class_init (ClutterGstPlaybackClass *klass)
                                 CLUTTER_GST_PARAM_READABLE);
   g_object_class_install_property (object_class, PROP_IN_SEEK, pspec);
 
+  /**
+   * ClutterGstPlayback:max-fps:
+   *
+   * Maximum number of frames per second to display, 0 for no limit.
+   * See #ClutterGstVideoSink:max-fps.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_double ("max-fps",
+                               "Maximum frame rate",
+                               "Maximum number of frames displayed per "
+                               "second, 0 for no limit",
+                               0.0, G_MAXDOUBLE, 0.0,
+                               CLUTTER_GST_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MAX_FPS, pspec);
+
 
   g_object_class_override_property (object_class,
                                     PROP_IDLE, "idle");
@@ -1954,7 +1979,7 @@ _pixel_aspect_ratio_changed (ClutterGstVideoSink   *sink,
                              GParamSpec            *spec,
                              ClutterGstPlayback    *self)
 {
-  clutter_gst_frame_update_pixel_aspect_ratio (self->priv->current_frame, sink);
+  clutter_gst_frame_update_pixel_aspect_ratio (&self->priv->current_frame, sink);
 }
 
 static GstElement *
@@ -2306,6 +2331,52 @@ clutter_gst_playback_set_seek_flags (ClutterGstPlayback  *self,
     priv->seek_flags = GST_SEEK_FLAG_ACCURATE;
 }
 
+/**
+ * clutter_gst_playback_get_max_fps:
+ * @self: a #ClutterGstPlayback
+ *
+ * Get the maximum number of frames displayed per second.
+ *
+ * Return value: the maximum frame rate, 0 if there is no limit
+ *
+ * Since: 3.0
+ */
+gdouble
+clutter_gst_playback_get_max_fps (ClutterGstPlayback *self)
+{
+  gdouble max_fps;
+
+  g_return_val_if_fail (CLUTTER_GST_IS_PLAYBACK (self), 0.0);
+
+  g_object_get (self->priv->video_sink, "max-fps", &max_fps, NULL);
+
+  return max_fps;
+}
+
+/**
+ * clutter_gst_playback_set_max_fps:
+ * @self: a #ClutterGstPlayback
+ * @max_fps: the maximum frame rate, 0 for no limit
+ *
+ * Limits the number of frames displayed per second. The frames above
+ * that rate are skipped as early as possible, saving both their
+ * decoding and their upload. Rates below one frame per hour are
+ * treated as one frame per hour.
+ *
+ * Since: 3.0
+ */
+void
+clutter_gst_playback_set_max_fps (ClutterGstPlayback *self,
+                                  gdouble             max_fps)
+{
+  g_return_if_fail (CLUTTER_GST_IS_PLAYBACK (self));
+  g_return_if_fail (max_fps >= 0.0);
+
+  g_object_set (self->priv->video_sink, "max-fps", max_fps, NULL);
+
+  g_object_notify (G_OBJECT (self), "max-fps");
+}
+
 /**
  * clutter_gst_playback_get_buffering_mode:
  * @self: a #ClutterGstPlayback
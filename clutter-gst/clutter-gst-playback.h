@@ -125,6 +125,10 @@ ClutterGstSeekFlags       clutter_gst_playback_get_seek_flags      (ClutterGstPl
 void                      clutter_gst_playback_set_seek_flags      (ClutterGstPlayback        *self,
                                                                     ClutterGstSeekFlags        flags);
 
+gdouble                   clutter_gst_playback_get_max_fps         (ClutterGstPlayback        *self);
+void                      clutter_gst_playback_set_max_fps         (ClutterGstPlayback        *self,
+                                                                    gdouble                    max_fps);
+
 ClutterGstBufferingMode   clutter_gst_playback_get_buffering_mode  (ClutterGstPlayback        *self);
 void                      clutter_gst_playback_set_buffering_mode  (ClutterGstPlayback        *self,
                                                                     ClutterGstBufferingMode    mode);
@@ -388,39 +388,55 @@ clutter_gst_player_update_frame (ClutterGstPlayer *player,
                                  ClutterGstFrame  *new_frame)
 {
   ClutterGstFrame *old_frame = *frame;
+  gint width, height;
 
-  *frame = g_boxed_copy (CLUTTER_GST_TYPE_FRAME, new_frame);
+  *frame = clutter_gst_frame_ref (new_frame);
 
   if (old_frame == NULL ||
       new_frame->resolution.width != old_frame->resolution.width ||
       new_frame->resolution.height != old_frame->resolution.height ||
       new_frame->resolution.par_n != old_frame->resolution.par_n ||
-      new_frame->resolution.par_d != old_frame->resolution.par_d)
+      new_frame->resolution.par_d != old_frame->resolution.par_d ||
+      new_frame->orientation != old_frame->orientation)
     {
-      g_signal_emit (player, signals[SIZE_CHANGE], 0,
-                     new_frame->resolution.width,
-                     new_frame->resolution.height);
+      clutter_gst_frame_get_display_size (new_frame, &width, &height);
+      g_signal_emit (player, signals[SIZE_CHANGE], 0, width, height);
     }
 
   if (old_frame)
-    g_boxed_free (CLUTTER_GST_TYPE_FRAME, old_frame);
+    clutter_gst_frame_unref (old_frame);
 
   g_signal_emit (player, signals[NEW_FRAME], 0, new_frame);
 }
 
+/* Frames are shared, the one in @frame is replaced by a new one with
+ * the updated aspect ratio */
 void
-clutter_gst_frame_update_pixel_aspect_ratio (ClutterGstFrame  *frame,
+clutter_gst_frame_update_pixel_aspect_ratio (ClutterGstFrame    **frame,
                                              ClutterGstVideoSink *sink)
 {
   GValue value = G_VALUE_INIT;
+  ClutterGstFrame *new_frame;
+
+  if (*frame == NULL)
+    return;
+
+  new_frame = clutter_gst_frame_new ();
+  new_frame->resolution = (*frame)->resolution;
+  new_frame->orientation = (*frame)->orientation;
+  if ((*frame)->pipeline != COGL_INVALID_HANDLE)
+    new_frame->pipeline = cogl_object_ref ((*frame)->pipeline);
 
   g_value_init (&value, GST_TYPE_FRACTION);
   g_object_get_property (G_OBJECT (sink),
                          "pixel-aspect-ratio",
                          &value);
 
-  frame->resolution.par_n = gst_value_get_fraction_numerator (&value);
-  frame->resolution.par_d = gst_value_get_fraction_denominator (&value);
+  new_frame->resolution.par_n = gst_value_get_fraction_numerator (&value);
+  new_frame->resolution.par_d = gst_value_get_fraction_denominator (&value);
 
   g_value_unset (&value);
+
+  clutter_gst_frame_unref (*frame);
+  *frame = new_frame;
 }
@@ -78,12 +78,19 @@ void clutter_gst_player_update_frame (ClutterGstPlayer *player,
                                       ClutterGstFrame **frame,
                                       ClutterGstFrame  *new_frame);
 
-void clutter_gst_frame_update_pixel_aspect_ratio (ClutterGstFrame     *frame,
+void clutter_gst_frame_update_pixel_aspect_ratio (ClutterGstFrame    **frame,
                                                   ClutterGstVideoSink *sink);
 
 void clutter_gst_video_resolution_from_video_info (ClutterGstVideoResolution *resolution,
                                                    GstVideoInfo              *info);
 
+void clutter_gst_video_sink_set_paint_stage (ClutterGstVideoSink *sink,
+                                             ClutterStage        *stage);
+
+void clutter_gst_frame_get_display_size (ClutterGstFrame *frame,
+                                         gint            *width,
+                                         gint            *height);
+
 
 gboolean clutter_gst_content_get_paint_frame (ClutterGstContent *content);
 gboolean clutter_gst_content_get_paint_overlays (ClutterGstContent *content);
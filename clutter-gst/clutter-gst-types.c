@@ -30,32 +30,50 @@
 ClutterGstFrame *
 clutter_gst_frame_new (void)
 {
-  return g_slice_new0 (ClutterGstFrame);
+  ClutterGstFrame *frame = g_slice_new0 (ClutterGstFrame);
+
+  frame->ref_count = 1;
+
+  return frame;
 }
 
-static gpointer
-clutter_gst_frame_copy (gpointer data)
+/**
+ * clutter_gst_frame_ref:
+ * @frame: a #ClutterGstFrame
+ *
+ * Increases the reference count of @frame, to share it with another
+ * consumer. This is also what g_boxed_copy() does on a frame.
+ *
+ * Return value: (transfer full): @frame
+ *
+ * Since: 3.0
+ */
+ClutterGstFrame *
+clutter_gst_frame_ref (ClutterGstFrame *frame)
 {
-  if (G_LIKELY (data))
-    {
-      ClutterGstFrame *frame = g_slice_dup (ClutterGstFrame, data);
+  g_return_val_if_fail (frame != NULL, NULL);
 
-      if (frame->pipeline != COGL_INVALID_HANDLE)
-        frame->pipeline = cogl_pipeline_copy (frame->pipeline);
-
-      return frame;
-    }
+  g_atomic_int_inc (&frame->ref_count);
 
-  return NULL;
+  return frame;
 }
 
-static void
-clutter_gst_frame_free (gpointer data)
+/**
+ * clutter_gst_frame_unref:
+ * @frame: a #ClutterGstFrame
+ *
+ * Decreases the reference count of @frame, releasing it when it drops
+ * to 0.
+ *
+ * Since: 3.0
+ */
+void
+clutter_gst_frame_unref (ClutterGstFrame *frame)
 {
-  if (G_LIKELY (data))
-    {
-      ClutterGstFrame *frame = (ClutterGstFrame *) data;
+  g_return_if_fail (frame != NULL);
 
+  if (g_atomic_int_dec_and_test (&frame->ref_count))
+    {
       if (frame->pipeline != COGL_INVALID_HANDLE)
         {
           cogl_object_unref (frame->pipeline);
@@ -67,8 +85,8 @@ clutter_gst_frame_free (gpointer data)
 
 G_DEFINE_BOXED_TYPE (ClutterGstFrame,
                      clutter_gst_frame,
-                     clutter_gst_frame_copy,
-                     clutter_gst_frame_free);
+                     clutter_gst_frame_ref,
+                     clutter_gst_frame_unref);
 
 
 ClutterGstOverlay *
@@ -120,37 +138,52 @@ clutter_gst_overlays_new (void)
   ClutterGstOverlays *overlays = g_slice_new0 (ClutterGstOverlays);
 
   overlays->overlays = g_ptr_array_new_with_free_func (clutter_gst_overlay_free);
+  overlays->ref_count = 1;
 
   return overlays;
 }
 
-static gpointer
-clutter_gst_overlays_copy (gpointer data)
+/**
+ * clutter_gst_overlays_ref:
+ * @overlays: a #ClutterGstOverlays
+ *
+ * Increases the reference count of @overlays, to share them with
+ * another consumer. This is also what g_boxed_copy() does on a set of
+ * overlays.
+ *
+ * Return value: (transfer full): @overlays
+ *
+ * Since: 3.0
+ */
+ClutterGstOverlays *
+clutter_gst_overlays_ref (ClutterGstOverlays *overlays)
 {
-  if (G_LIKELY (data))
-    {
-      ClutterGstOverlays *overlays = clutter_gst_overlays_new ();
-      GPtrArray *src_overlays = ((ClutterGstOverlays *) data)->overlays;
-      guint i;
-
-      for (i = 0; i < src_overlays->len; i++)
-        g_ptr_array_add (overlays->overlays,
-                         clutter_gst_overlay_copy (g_ptr_array_index (src_overlays,
-                                                                      i)));
-      return overlays;
-    }
+  g_return_val_if_fail (overlays != NULL, NULL);
 
-  return NULL;
+  g_atomic_int_inc (&overlays->ref_count);
+
+  return overlays;
 }
 
-static void
-clutter_gst_overlays_free (gpointer data)
+/**
+ * clutter_gst_overlays_unref:
+ * @overlays: a #ClutterGstOverlays
+ *
+ * Decreases the reference count of @overlays, releasing them when it
+ * drops to 0.
+ *
+ * Since: 3.0
+ */
+void
+clutter_gst_overlays_unref (ClutterGstOverlays *overlays)
 {
-  if (G_LIKELY (data))
-    {
-      ClutterGstOverlays *overlays = (ClutterGstOverlays *) data;
+  g_return_if_fail (overlays != NULL);
 
+  if (g_atomic_int_dec_and_test (&overlays->ref_count))
+    {
       g_ptr_array_unref (overlays->overlays);
+      if (overlays->pipeline != COGL_INVALID_HANDLE)
+        cogl_object_unref (overlays->pipeline);
 
       g_slice_free (ClutterGstOverlays, overlays);
     }
@@ -158,8 +191,8 @@ clutter_gst_overlays_free (gpointer data)
 
 G_DEFINE_BOXED_TYPE (ClutterGstOverlays,
                      clutter_gst_overlays,
-                     clutter_gst_overlays_copy,
-                     clutter_gst_overlays_free);
+                     clutter_gst_overlays_ref,
+                     clutter_gst_overlays_unref);
 
 static ClutterGstBox *
 clutter_gst_box_copy (const ClutterGstBox *box)
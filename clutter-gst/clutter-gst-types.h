@@ -75,6 +75,38 @@ typedef enum _ClutterGstBufferingMode
   CLUTTER_GST_BUFFERING_MODE_DOWNLOAD
 } ClutterGstBufferingMode;
 
+/**
+ * ClutterGstVideoOrientation:
+ * @CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY: No rotation
+ * @CLUTTER_GST_VIDEO_ORIENTATION_90R: Rotated clockwise by 90 degrees
+ * @CLUTTER_GST_VIDEO_ORIENTATION_180: Rotated by 180 degrees
+ * @CLUTTER_GST_VIDEO_ORIENTATION_90L: Rotated counter-clockwise by 90
+ *   degrees
+ * @CLUTTER_GST_VIDEO_ORIENTATION_HORIZ: Flipped horizontally
+ * @CLUTTER_GST_VIDEO_ORIENTATION_VERT: Flipped vertically
+ * @CLUTTER_GST_VIDEO_ORIENTATION_UL_LR: Flipped across the upper left to
+ *   lower right diagonal
+ * @CLUTTER_GST_VIDEO_ORIENTATION_UR_LL: Flipped across the upper right to
+ *   lower left diagonal
+ *
+ * The transformation applied to the decoded video to display it, as
+ * given by the image orientation tags of the stream or the affine
+ * transformation meta of its buffers.
+ *
+ * Since: 3.0
+ */
+typedef enum _ClutterGstVideoOrientation
+{
+  CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY,
+  CLUTTER_GST_VIDEO_ORIENTATION_90R,
+  CLUTTER_GST_VIDEO_ORIENTATION_180,
+  CLUTTER_GST_VIDEO_ORIENTATION_90L,
+  CLUTTER_GST_VIDEO_ORIENTATION_HORIZ,
+  CLUTTER_GST_VIDEO_ORIENTATION_VERT,
+  CLUTTER_GST_VIDEO_ORIENTATION_UL_LR,
+  CLUTTER_GST_VIDEO_ORIENTATION_UR_LL
+} ClutterGstVideoOrientation;
+
 /**
  * ClutterGstBox:
  * @x1: X coordinate of the top left corner
@@ -118,8 +150,25 @@ struct _ClutterGstVideoResolution
  * ClutterGstFrame:
  * @resolution: a #ClutterGstVideoResolution
  * @pipeline: a #CoglPipeline to paint a frame
+ * @orientation: the #ClutterGstVideoOrientation of the frame
+ *
+ * Represents a frame outputted by the #ClutterGstVideoSink. Frames are
+ * reference counted and shared between all their consumers, which must
+ * not modify the structure. A frame is not a snapshot though: the sink
+ * keeps uploading the following frames into the textures of the same
+ * pipeline, so painting an older frame shows the current video. Make a
+ * copy of the pipeline with cogl_pipeline_copy() to change its state.
+ *
+ * Since 3.0, g_boxed_copy() returns a new reference on the same frame,
+ * like clutter_gst_frame_ref(), instead of a copy of it.
  *
- * Represents a frame outputted by the #ClutterGstVideoSink.
+ * When the video is cropped, for example to remove the padding added
+ * by a decoder, the resolution is the size of the visible part and
+ * the texture matrix of the pipeline maps the (0, 0) - (1, 1) texture
+ * coordinates onto that part.
+ *
+ * The orientation is applied by the texture matrix of the pipeline as
+ * well, the resolution is the one of the frame before its rotation.
  *
  * Since: 3.0
  */
@@ -127,6 +176,10 @@ struct _ClutterGstFrame
 {
   ClutterGstVideoResolution  resolution;
   CoglPipeline              *pipeline;
+  ClutterGstVideoOrientation orientation;
+
+  /*< private >*/
+  gint                       ref_count;
 };
 
 /**
@@ -134,26 +187,61 @@ struct _ClutterGstFrame
  * @position: a #ClutterGstBox representing the position of the
  *            overlay within a #ClutterGstFrame.
  * @pipeline: a #CoglPipeline to paint an overlay
+ * @atlas_region: a #ClutterGstBox representing the texture
+ *                coordinates of the overlay within the atlas of the
+ *                #ClutterGstOverlays it belongs to.
+ * @in_atlas: whether the overlay is packed in the atlas of the
+ *            #ClutterGstOverlays it belongs to. Overlays that didn't
+ *            fit have to be painted with @pipeline, @atlas_region then
+ *            covering the whole texture of @pipeline.
  *
  * Represents a video overlay outputted by the #ClutterGstVideoSink.
  *
+ * Overlays are rotated and flipped along with the frame: @position is
+ * in pixels of the frame as displayed, whose width and height are
+ * swapped compared to its resolution for the rotations by 90 degrees
+ * and the diagonal flips. Both @pipeline and @atlas_region take the
+ * orientation into account, the bounds of @atlas_region are reversed
+ * along flipped axes.
+ *
  * Since: 3.0
  */
 struct _ClutterGstOverlay
 {
   ClutterGstBox  position;
   CoglPipeline  *pipeline;
+  ClutterGstBox  atlas_region;
+  gboolean       in_atlas;
 };
 
 /**
  * ClutterGstOverlays:
  * @overlays: an array of #ClutterGstOverlay
+ * @pipeline: a #CoglPipeline sampling the atlas all the overlays are
+ *            packed in, or %NULL. Painting each overlay with this
+ *            pipeline and its atlas region as texture coordinates
+ *            allows to draw all of them at once, except the ones
+ *            whose in_atlas field is %FALSE.
+ *
+ * A set of overlays outputted by the #ClutterGstVideoSink. It is
+ * reference counted and shared between all its consumers, which must
+ * not modify the structure. A new set is handed out whenever the
+ * overlays change, but the atlas sampled by @pipeline is shared with
+ * the sets that follow. The regions of the atlas used by a set are
+ * never overwritten, a set stays valid for as long as it is held.
+ *
+ * Since 3.0, g_boxed_copy() returns a new reference on the same set,
+ * like clutter_gst_overlays_ref(), instead of a copy of it.
  *
  * Since: 3.0
  */
 struct _ClutterGstOverlays
 {
-  GPtrArray *overlays;
+  GPtrArray    *overlays;
+  CoglPipeline *pipeline;
+
+  /*< private >*/
+  gint          ref_count;
 };
 
 GType clutter_gst_frame_get_type     (void) G_GNUC_CONST;
@@ -161,6 +249,12 @@ GType clutter_gst_box_get_type       (void) G_GNUC_CONST;
 GType clutter_gst_overlay_get_type   (void) G_GNUC_CONST;
 GType clutter_gst_overlays_get_type  (void) G_GNUC_CONST;
 
+ClutterGstFrame *    clutter_gst_frame_ref      (ClutterGstFrame *frame);
+void                 clutter_gst_frame_unref    (ClutterGstFrame *frame);
+
+ClutterGstOverlays * clutter_gst_overlays_ref   (ClutterGstOverlays *overlays);
+void                 clutter_gst_overlays_unref (ClutterGstOverlays *overlays);
+
 gfloat clutter_gst_box_get_width     (const ClutterGstBox *box);
 gfloat clutter_gst_box_get_height    (const ClutterGstBox *box);
 
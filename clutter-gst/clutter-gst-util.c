@@ -274,3 +274,26 @@ clutter_gst_video_resolution_from_video_info (ClutterGstVideoResolution *resolut
   resolution->par_n = info->par_n;
   resolution->par_d = info->par_d;
 }
+
+/* Size of the frame once its orientation is applied */
+void
+clutter_gst_frame_get_display_size (ClutterGstFrame *frame,
+                                    gint            *width,
+                                    gint            *height)
+{
+  switch (frame->orientation)
+    {
+    case CLUTTER_GST_VIDEO_ORIENTATION_90R:
+    case CLUTTER_GST_VIDEO_ORIENTATION_90L:
+    case CLUTTER_GST_VIDEO_ORIENTATION_UL_LR:
+    case CLUTTER_GST_VIDEO_ORIENTATION_UR_LL:
+      *width = frame->resolution.height;
+      *height = frame->resolution.width;
+      break;
+
+    default:
+      *width = frame->resolution.width;
+      *height = frame->resolution.height;
+      break;
+    }
+}
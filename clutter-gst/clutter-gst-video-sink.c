@@ -86,6 +86,9 @@
 #include <math.h>
 
 #include "clutter-gst-video-sink.h"
+#include "clutter-gst-pixel-buffer-allocator.h"
+#include "clutter-gst-pixel-buffer-pool.h"
+#include "clutter-gst-cpu-convert.h"
 #include "clutter-gst-private.h"
 
 GST_DEBUG_CATEGORY_STATIC (clutter_gst_video_sink_debug);
@@ -93,15 +96,39 @@ GST_DEBUG_CATEGORY_STATIC (clutter_gst_video_sink_debug);
 
 #define CLUTTER_GST_DEFAULT_PRIORITY G_PRIORITY_HIGH_IDLE
 
+/* 10 and 12 bits formats, stored in 16 bits little endian words */
+#if GST_CHECK_VERSION (1, 12, 0)
+#define HIGH_DEPTH_PLANAR_CAPS "{ I420_10LE, I422_10LE, Y444_10LE, " \
+  "I420_12LE, I422_12LE, Y444_12LE }"
+#define HIGH_DEPTH_SINK_CAPS "I420_10LE, I422_10LE, Y444_10LE, " \
+  "I420_12LE, I422_12LE, Y444_12LE, P010_10LE,"
+#elif GST_CHECK_VERSION (1, 10, 0)
+#define HIGH_DEPTH_PLANAR_CAPS "{ I420_10LE, I422_10LE, Y444_10LE }"
+#define HIGH_DEPTH_SINK_CAPS "I420_10LE, I422_10LE, Y444_10LE, P010_10LE,"
+#else
+#define HIGH_DEPTH_PLANAR_CAPS "{ I420_10LE, I422_10LE, Y444_10LE }"
+#define HIGH_DEPTH_SINK_CAPS "I420_10LE, I422_10LE, Y444_10LE,"
+#endif
+
 #define BASE_SINK_CAPS "{ AYUV,"                \
   "YV12,"                                       \
   "I420,"                                       \
+  "Y42B,"                                       \
+  "Y444,"                                       \
+  "GRAY8,"                                      \
+  "YUY2,"                                       \
+  "UYVY,"                                       \
+  "YVYU,"                                       \
   "RGBA,"                                       \
   "BGRA,"                                       \
   "RGBX,"                                       \
   "BGRX,"                                       \
   "RGB,"                                        \
   "BGR,"                                        \
+  HIGH_DEPTH_SINK_CAPS                          \
+  "NV21,"                                       \
+  "NV16,"                                       \
+  "NV61,"                                       \
   "NV12 }"
 
 
@@ -115,9 +142,9 @@ static const char clutter_gst_video_sink_caps_str[] =
   MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY, BASE_SINK_CAPS)
 #ifdef HAVE_GL_TEXTURE_UPLOAD
   ";"
-  MAKE_CAPS_COMPOSITON (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META, "{ RGBA }")
+  MAKE_CAPS_COMPOSITON (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META, "{ RGBA, NV12, I420 }")
   ";"
-  MAKE_CAPS (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META, "{ RGBA }")
+  MAKE_CAPS (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META, "{ RGBA, NV12, I420 }")
 #endif
   ";"
   MAKE_CAPS_COMPOSITON (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY, BASE_SINK_CAPS)
@@ -143,7 +170,15 @@ G_DEFINE_TYPE_WITH_CODE (ClutterGstVideoSink,
 enum
 {
   PROP_0,
-  PROP_UPDATE_PRIORITY
+  PROP_UPDATE_PRIORITY,
+  PROP_STATS,
+  PROP_UPLOAD_ON_PAINT,
+  PROP_MAIN_CONTEXT,
+  PROP_THREADED_UPLOAD,
+  PROP_GL_TEXTURE_RING_SIZE,
+  PROP_VBLANK_ALIGNED,
+  PROP_MAX_FPS,
+  PROP_QOS
 };
 
 enum
@@ -164,10 +199,14 @@ typedef enum
   CLUTTER_GST_RGB32,
   CLUTTER_GST_RGB24,
   CLUTTER_GST_AYUV,
-  CLUTTER_GST_YV12,
   CLUTTER_GST_SURFACE,
-  CLUTTER_GST_I420,
-  CLUTTER_GST_NV12
+  CLUTTER_GST_PLANAR,
+  CLUTTER_GST_SEMI_PLANAR,
+  CLUTTER_GST_YUY2,
+  CLUTTER_GST_UYVY,
+  CLUTTER_GST_YVYU,
+  CLUTTER_GST_PLANAR_16,
+  CLUTTER_GST_P010
 } ClutterGstVideoFormat;
 
 typedef enum
@@ -193,13 +232,169 @@ typedef struct
   GQueue entries;
 } SnippetCache;
 
+/* Textures backing the layers of the current frame are kept across
+ * frames and updated in place as long as the format and the size of
+ * the plane uploaded into them don't change. */
+typedef struct
+{
+  CoglPixelFormat format;
+  int width;
+  int height;
+} ClutterGstTextureKey;
+
+/* Plane upload recorded while uploading a buffer living in a pixel
+ * buffer, performed from the pixel buffer once the renderer is done
+ * with the buffer. */
+typedef struct
+{
+  guint layer;
+  int width;
+  int height;
+  CoglPixelFormat format;
+  int rowstride;
+  const uint8_t *data;
+} ClutterGstPendingUpload;
+
+/* Textures a frame carrying a GstVideoGLTextureUploadMeta gets uploaded
+ * into. The buffer is kept alive until the set gets reused, as the
+ * textures might still be sampled from it until then. */
+typedef struct
+{
+  CoglTexture *textures[3];
+  GstBuffer *buffer;
+} ClutterGstGLTextureSet;
+
+#define DEFAULT_GL_TEXTURE_RING_SIZE (3)
+
+/* Number of frames the streaming thread can queue before the main loop
+ * gets to them, must be a power of 2 */
+#define CLUTTER_GST_FRAME_QUEUE_SIZE (4)
+
+typedef struct
+{
+  GstBuffer *buffer;
+  GstClockTime pts;
+  gint64 queued_time;
+  /* Where the frame sits on the clock, for QoS */
+  GstClockTime running_time;
+  GstClockTime duration;
+  /* Caps negotiated before this frame, to apply before uploading it */
+  GstCaps *caps;
+  gint flush_seqnum;
+} ClutterGstQueuedFrame;
+
+/* How late a frame can be painted when its duration isn't known */
+#define DEFAULT_QOS_SLACK (20 * GST_MSECOND)
+
+/* Assumed until the stage reports its actual refresh rate */
+#define DEFAULT_REFRESH_INTERVAL (GST_SECOND / 60)
+
+/* Number of frames the display delay is averaged over, and how far
+ * the average has to drift before the render delay is updated */
+#define DISPLAY_DELAY_WINDOW (30)
+#define DISPLAY_DELAY_THRESHOLD (2 * GST_MSECOND)
+#define MAX_DISPLAY_DELAY (200 * GST_MSECOND)
+
+/* Longest time between two frames the "max-fps" property can ask for,
+ * lower rates are clamped to it */
+#define MAX_THROTTLE_TIME (3600 * GST_SECOND)
+
+/* Pixel buffers kept ready on top of the ones of the proposed pool, for
+ * decoders that need more buffers than we ask for */
+#define PIXEL_BUFFER_SPARES (4)
+
+/* Buffers upstream needs in flight: the one being rendered, the one
+ * held as last sample, and the last uploaded one we keep to spot
+ * repeats, see clutter_gst_video_sink_is_repeated_buffer() */
+#define MIN_BUFFERS (3)
+
+/* Counters exposed through the "stats" property, they are updated with
+ * atomic operations as they can be read from any thread */
+typedef struct
+{
+  gint rendered;
+  gint dropped;
+  gint overflowed;
+  gint uploaded;
+  gint upload_failures;
+  gint renegotiations;
+  gint pipeline_rebuilds;
+  gint texture_swaps;
+  gint texture_pool_hits;
+  gint texture_pool_misses;
+  gint pbo_uploads;
+  gint copy_uploads;
+  gint pbo_fallbacks;
+  gint staged;
+  gint late;
+  gint repeated;
+} ClutterGstVideoSinkStats;
+
+/* Durations, updated from the main loop with the object lock held */
+typedef struct
+{
+  guint64 count;
+  GstClockTime min;
+  GstClockTime max;
+  GstClockTime total;
+} ClutterGstTiming;
+
+/* Presentation timing of one stage, main loop only */
+typedef struct
+{
+  ClutterStage *stage;
+  gulong presented_id;
+  gboolean presentation_known;
+  gint64 last_presentation;
+  gint64 refresh_interval;
+} ClutterGstStageTiming;
+
+/* A rectangle of the overlay atlas, see the Overlays section */
+typedef struct
+{
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+  /* Texture of its own for a rectangle that didn't fit in the atlas */
+  CoglTexture *texture;
+  /* Samples the entry alone, for ClutterGstOverlay:pipeline, with the
+   * orientation of the frame */
+  CoglPipeline *pipeline;
+  ClutterGstVideoOrientation orientation;
+} ClutterGstAtlasEntry;
+
+typedef struct
+{
+  gint size;
+  gint shelf_x;
+  gint shelf_y;
+  gint shelf_height;
+} ClutterGstAtlasPacker;
+
 typedef struct _ClutterGstSource
 {
   GSource source;
   ClutterGstVideoSink *sink;
-  GMutex buffer_lock;
-  GstBuffer *buffer;
-  gboolean has_new_caps;
+
+  /* Frames are passed from the streaming thread to the main loop
+   * through a single producer/single consumer ring: the streaming
+   * thread is the only one writing the slots and advancing head, the
+   * source's dispatch is the only one reading them and advancing tail.
+   * Flushing (which happens from yet another thread) only bumps
+   * flush_seqnum, the frames queued before that are then discarded by
+   * the dispatch. */
+  ClutterGstQueuedFrame frames[CLUTTER_GST_FRAME_QUEUE_SIZE];
+  gint head;
+  gint tail;
+  gint flush_seqnum;
+
+  /* Only touched by the streaming thread */
+  GstCaps *pending_caps;
+
+  /* When uploading on paint, whether a stage frame that will pick up
+   * the queued frames is already on its way */
+  gboolean redraw_queued;
 } ClutterGstSource;
 
 typedef void (ClutterGstRendererPaint) (ClutterGstVideoSink *);
@@ -229,17 +424,115 @@ struct _ClutterGstVideoSinkPrivate
   ClutterGstFrame *clt_frame;
 
   CoglTexture *frame[3];
+  ClutterGstTextureKey frame_key[3];
+
+  gboolean has_pixel_buffers;
+  GstAllocator *allocator;
+  GstBufferPool *pool;
+  gboolean threaded_upload;
+  GstBufferPool *staging_pool;
+  GstVideoInfo staging_info;
+  gboolean defer_uploads;
+  ClutterGstPendingUpload pending[3];
+  guint n_pending;
+
   gboolean frame_dirty;
   gboolean had_upload_once;
 
+  /* Visible part of the uploaded frame, in texture coordinates, and
+   * its size in pixels */
+  ClutterGstBox crop_region;
+  gint crop_width;
+  gint crop_height;
+  gboolean texture_matrix_dirty;
+
+  /* Orientation given by the tags (atomic, set from the streaming
+   * thread) and the one of the frame uploaded */
+  gint tag_orientation;
+  ClutterGstVideoOrientation orientation;
+  /* Kept until the next upload, see
+   * clutter_gst_video_sink_is_repeated_buffer() */
+  GstBuffer *last_buffer;
+
+  /* Whether the negotiated caps carry the GL texture upload meta */
+  gboolean gl_upload;
+  ClutterGstGLTextureSet *gl_ring;
+  guint gl_ring_length;
+  guint gl_ring_next;
+  guint gl_texture_ring_size;
+
+  /* YUV to RGB conversion for contexts without GLSL */
+  ClutterGstCpuConverter *cpu_converter;
+  guint8 *cpu_rgbx;
+  gsize cpu_rgbx_size;
+
   ClutterGstVideoFormat format;
   gboolean bgr;
 
   ClutterGstSource *source;
+  /* Context set through the property, protected by the object lock, and
+   * the one the source is attached to while the sink is started */
+  GMainContext *main_context;
+  GMainContext *dispatch_context;
+  gboolean upload_on_paint;
+  /* Set once the repaint functions and the stage tracking are set up,
+   * from the first dispatch, see clutter_gst_video_sink_setup_clutter() */
+  gint clutter_setup; /* atomic */
+  guint repaint_func_id;
   GSList *renderers;
   GstCaps *caps;
   ClutterGstRenderer *renderer;
-  GstFlowReturn flow_return;
+  gint flow_return; /* GstFlowReturn, atomic */
+
+  ClutterGstVideoSinkStats stats;
+  GHashTable *upload_timings;
+  ClutterGstTiming dispatch_latency;
+  ClutterGstTiming prewarm_timing;
+  ClutterGstTiming paint_lateness;
+
+  /* Last presented frame, checked against the clock once painted, see
+   * clutter_gst_video_sink_post_paint() */
+  guint post_paint_func_id;
+  gboolean qos_pending;
+  gint qos_flush_seqnum;
+  GstClockTime qos_running_time;
+  GstClockTime qos_duration;
+  gdouble qos_proportion; /* object lock */
+  /* The "qos" property. basesink's own QoS stays disabled: it would
+   * report frames on time as soon as they are queued, contradicting
+   * the events sent once they are painted. */
+  gint qos_enabled;
+
+  /* Difference between the intervals frames were painted at and the
+   * intervals between their running times */
+  ClutterGstTiming cadence;
+  GstClockTime cadence_last_paint;
+  GstClockTime cadence_last_running_time;
+
+  /* Frames are picked for the vblank the stage frame being painted
+   * will be presented at, predicted from the last presentation */
+  gboolean vblank_aligned;
+  gdouble max_fps;
+
+  /* Stages being tracked, and the one the video was last painted on,
+   * see clutter_gst_video_sink_set_paint_stage() */
+  GHashTable *stage_timings;
+  gulong stage_added_id;
+  gulong stage_removed_id;
+  ClutterStage *paint_stage;
+
+  /* Added to the render delay set on basesink, object lock */
+  GstClockTime lookahead;
+  GstClockTime display_delay;
+  GstClockTime render_delay_added;
+  /* Lateness of the frame last painted, completed by the presentation
+   * time when the stage it was painted on reports it */
+  ClutterStage *lateness_stage;
+  gint64 paint_clock_time;
+  GstClockTimeDiff pending_lateness;
+  gboolean lateness_pending;
+  GstClockTimeDiff lateness_sum;
+  guint lateness_count;
   int custom_start;
   int video_start;
   gboolean default_sample;
@@ -251,226 +544,920 @@ struct _ClutterGstVideoSinkPrivate
   gdouble saturation;
   gboolean balance_dirty;
 
-  guint8 *tabley;
-  guint8 *tableu;
-  guint8 *tablev;
-
   /**/
   GstVideoOverlayComposition *last_composition;
   ClutterGstOverlays *overlays;
+  /* Orientation the positions of the overlays handed out are in */
+  ClutterGstVideoOrientation overlays_orientation;
+  /* Atlas entries of the overlay rectangles, indexed by their seqnum */
+  GHashTable *overlay_cache;
+  CoglTexture *atlas;
+  CoglPipeline *atlas_pipeline;
+  ClutterGstAtlasPacker atlas_packer;
+  /* Largest atlas Cogl managed to allocate so far */
+  gint atlas_max_size;
+};
+
+/* Orientation
+ *
+ * Rotations and flips are applied with the texture matrix, on top of
+ * the crop (see the Crop section), and to the overlays. Each
+ * orientation maps the (u, v) coordinates of the displayed frame to
+ * coordinates in the uploaded one, with s = a * u + b * v and
+ * t = c * u + d * v (plus 1 for each negative factor), the factors
+ * being given below as { a, b, c, d }. */
+
+static const gint orientation_maps[][4] = {
+  [CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY] = {  1,  0,  0,  1 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_90R]      = {  0,  1, -1,  0 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_180]      = { -1,  0,  0, -1 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_90L]      = {  0, -1,  1,  0 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_HORIZ]    = { -1,  0,  0,  1 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_VERT]     = {  1,  0,  0, -1 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_UL_LR]    = {  0,  1,  1,  0 },
+  [CLUTTER_GST_VIDEO_ORIENTATION_UR_LL]    = {  0, -1, -1,  0 }
 };
 
-/* Overlays */
+/* Returns -1 if @map isn't one of the orientations */
+static gint
+clutter_gst_orientation_from_map (const gint map[4])
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (orientation_maps); i++)
+    if (memcmp (orientation_maps[i], map, sizeof (orientation_maps[i])) == 0)
+      return i;
+
+  return -1;
+}
+
+/* Orientation applying @first, then @second */
+static ClutterGstVideoOrientation
+clutter_gst_orientation_compose (ClutterGstVideoOrientation first,
+                                 ClutterGstVideoOrientation second)
+{
+  const gint *f = orientation_maps[first], *s = orientation_maps[second];
+  gint map[4];
+
+  /* The coordinates are mapped back, by the second one first */
+  map[0] = f[0] * s[0] + f[1] * s[2];
+  map[1] = f[0] * s[1] + f[1] * s[3];
+  map[2] = f[2] * s[0] + f[3] * s[2];
+  map[3] = f[2] * s[1] + f[3] * s[3];
+
+  return clutter_gst_orientation_from_map (map);
+}
+
+/* Same strings as the videoflip element */
+static ClutterGstVideoOrientation
+clutter_gst_orientation_from_tag (const gchar *tag)
+{
+  static const struct
+  {
+    const gchar *tag;
+    ClutterGstVideoOrientation orientation;
+  } tags[] = {
+    { "rotate-0", CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY },
+    { "rotate-90", CLUTTER_GST_VIDEO_ORIENTATION_90R },
+    { "rotate-180", CLUTTER_GST_VIDEO_ORIENTATION_180 },
+    { "rotate-270", CLUTTER_GST_VIDEO_ORIENTATION_90L },
+    { "flip-rotate-0", CLUTTER_GST_VIDEO_ORIENTATION_HORIZ },
+    { "flip-rotate-90", CLUTTER_GST_VIDEO_ORIENTATION_UL_LR },
+    { "flip-rotate-180", CLUTTER_GST_VIDEO_ORIENTATION_VERT },
+    { "flip-rotate-270", CLUTTER_GST_VIDEO_ORIENTATION_UR_LL }
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (tags); i++)
+    if (g_strcmp0 (tags[i].tag, tag) == 0)
+      return tags[i].orientation;
+
+  return CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY;
+}
+
+#if GST_CHECK_VERSION (1, 8, 0)
+/* The meta transforms the vertices of the frame, in a space where y
+ * goes up. Only rotations and flips are supported, returns -1 for
+ * anything else. */
+static gint
+clutter_gst_orientation_from_affine_meta (GstVideoAffineTransformationMeta *meta)
+{
+  const gfloat *m = meta->matrix;
+  gfloat linear[4];
+  gint map[4], i;
+
+  /* Moved to a space where y goes down, then inverted into a mapping
+   * of the coordinates, which is the transpose for rotations and
+   * flips */
+  linear[0] = m[0];
+  linear[1] = -m[1];
+  linear[2] = -m[4];
+  linear[3] = m[5];
+
+  for (i = 0; i < 4; i++)
+    {
+      map[i] = (gint) roundf (linear[i]);
+      if (fabsf (linear[i] - map[i]) > 0.001f)
+        return -1;
+    }
+
+  return clutter_gst_orientation_from_map (map);
+}
+#endif
 
+/* Texture matrix mapping the coordinates of the displayed frame to the
+ * ones in the uploaded one */
 static void
-clutter_gst_video_sink_upload_overlay (ClutterGstVideoSink *sink, GstBuffer *buffer)
+clutter_gst_orientation_get_matrix (ClutterGstVideoOrientation orientation,
+                                    CoglMatrix *matrix)
 {
-  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  const gint *map = orientation_maps[orientation];
+  const float array[16] = {
+    map[0], map[2], 0.0f, 0.0f,
+    map[1], map[3], 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    (map[0] < 0 || map[1] < 0) ? 1.0f : 0.0f,
+    (map[2] < 0 || map[3] < 0) ? 1.0f : 0.0f,
+    0.0f, 1.0f
+  };
 
-  GstVideoOverlayComposition *composition = NULL;
-  GstVideoOverlayCompositionMeta *composition_meta;
-  guint i, nb_rectangle;
+  cogl_matrix_init_from_array (matrix, array);
+}
 
-  composition_meta = gst_buffer_get_video_overlay_composition_meta (buffer);
-  if (composition_meta)
-    composition = composition_meta->overlay;
+/* Whether the orientation swaps the width and the height */
+static gboolean
+clutter_gst_orientation_transposes (ClutterGstVideoOrientation orientation)
+{
+  return orientation_maps[orientation][0] == 0;
+}
 
-  if (composition == NULL)
+/* [@from1, @from2] as seen along an axis flipped if @factor is negative,
+ * in normalized coordinates if @normalized, or inverting the order of
+ * the bounds only otherwise */
+static void
+clutter_gst_orientation_map_range (gint factor,
+                                   gboolean normalized,
+                                   gfloat from1,
+                                   gfloat from2,
+                                   gfloat *to1,
+                                   gfloat *to2)
+{
+  if (factor > 0)
     {
-      if (priv->last_composition != NULL)
-        {
-          gst_video_overlay_composition_unref (priv->last_composition);
-          priv->last_composition = NULL;
+      *to1 = from1;
+      *to2 = from2;
+    }
+  else if (normalized)
+    {
+      *to1 = 1.0f - from2;
+      *to2 = 1.0f - from1;
+    }
+  else
+    {
+      *to1 = from2;
+      *to2 = from1;
+    }
+}
 
-          if (priv->overlays)
-            g_boxed_free (CLUTTER_GST_TYPE_OVERLAYS, priv->overlays);
-          priv->overlays = clutter_gst_overlays_new ();
+/* Maps @box, in pixels of a @width x @height frame, to the pixels of
+ * the frame displayed with @orientation */
+static void
+clutter_gst_orientation_map_box (ClutterGstVideoOrientation orientation,
+                                 gint width,
+                                 gint height,
+                                 const ClutterGstBox *box,
+                                 ClutterGstBox *mapped)
+{
+  const gint *map = orientation_maps[orientation];
+  gfloat s1 = box->x1 / width, s2 = box->x2 / width;
+  gfloat t1 = box->y1 / height, t2 = box->y2 / height;
 
-          g_signal_emit (sink, video_sink_signals[NEW_OVERLAYS], 0);
-        }
-      return;
+  if (clutter_gst_orientation_transposes (orientation))
+    {
+      clutter_gst_orientation_map_range (map[2], TRUE, t1, t2,
+                                         &mapped->x1, &mapped->x2);
+      clutter_gst_orientation_map_range (map[1], TRUE, s1, s2,
+                                         &mapped->y1, &mapped->y2);
+      mapped->x1 *= height;
+      mapped->x2 *= height;
+      mapped->y1 *= width;
+      mapped->y2 *= width;
+    }
+  else
+    {
+      clutter_gst_orientation_map_range (map[0], TRUE, s1, s2,
+                                         &mapped->x1, &mapped->x2);
+      clutter_gst_orientation_map_range (map[3], TRUE, t1, t2,
+                                         &mapped->y1, &mapped->y2);
+      mapped->x1 *= width;
+      mapped->x2 *= width;
+      mapped->y1 *= height;
+      mapped->y2 *= height;
     }
+}
 
-  g_clear_pointer (&priv->last_composition, gst_video_overlay_composition_unref);
-  priv->last_composition = gst_video_overlay_composition_ref (composition);
-  if (priv->overlays)
-    g_boxed_free (CLUTTER_GST_TYPE_OVERLAYS, priv->overlays);
-  priv->overlays = clutter_gst_overlays_new ();
+/* Texture coordinates painting @region of the overlay atlas with
+ * @orientation. The flips swap the bounds, the rotations rely on the
+ * atlas pipeline transposing the coordinates. */
+static void
+clutter_gst_orientation_map_region (ClutterGstVideoOrientation orientation,
+                                    const ClutterGstBox *region,
+                                    ClutterGstBox *mapped)
+{
+  const gint *map = orientation_maps[orientation];
 
-  nb_rectangle = gst_video_overlay_composition_n_rectangles (composition);
-  for (i = 0; i < nb_rectangle; i++)
+  if (clutter_gst_orientation_transposes (orientation))
     {
-      GstVideoOverlayRectangle *rectangle;
-      GstBuffer *comp_buffer;
-      GstMapInfo info;
-      GstVideoMeta *vmeta;
-      gpointer data;
-      gint comp_x, comp_y, stride;
-      guint comp_width, comp_height;
-      CoglTexture *tex;
-      CoglError *error;
+      clutter_gst_orientation_map_range (map[2], FALSE, region->y1, region->y2,
+                                         &mapped->x1, &mapped->x2);
+      clutter_gst_orientation_map_range (map[1], FALSE, region->x1, region->x2,
+                                         &mapped->y1, &mapped->y2);
+    }
+  else
+    {
+      clutter_gst_orientation_map_range (map[0], FALSE, region->x1, region->x2,
+                                         &mapped->x1, &mapped->x2);
+      clutter_gst_orientation_map_range (map[3], FALSE, region->y1, region->y2,
+                                         &mapped->y1, &mapped->y2);
+    }
+}
 
-      rectangle = gst_video_overlay_composition_get_rectangle (composition, i);
-      comp_buffer =
-        gst_video_overlay_rectangle_get_pixels_unscaled_argb (rectangle,
-                                                              GST_VIDEO_OVERLAY_FORMAT_FLAG_PREMULTIPLIED_ALPHA);
+/* Overlays
+ *
+ * The rectangles of the overlay composition are packed into a single
+ * atlas texture, in rows (shelves) filled from left to right, so that
+ * the content classes can paint all of them with one pipeline. Each
+ * rectangle is uploaded once and then found through its seqnum. When a
+ * new rectangle doesn't fit in the space left, the atlas is repacked
+ * with the rectangles of the current composition only, into a new
+ * atlas, grown if needed: the overlays already handed out keep the old
+ * one. The atlas can't grow past the largest texture Cogl manages
+ * to allocate, the rectangles that still don't fit are given textures
+ * of their own and painted separately. */
+
+#define OVERLAY_ATLAS_MIN_SIZE (256)
+#define OVERLAY_ATLAS_MAX_SIZE (4096)
 
-      gst_video_overlay_rectangle_get_render_rectangle (rectangle,
-                                                        &comp_x, &comp_y, &comp_width, &comp_height);
+static void
+clutter_gst_atlas_entry_free (ClutterGstAtlasEntry *entry)
+{
+  if (entry->texture)
+    cogl_object_unref (entry->texture);
+  cogl_object_unref (entry->pipeline);
+  g_slice_free (ClutterGstAtlasEntry, entry);
+}
+
+static void
+clutter_gst_atlas_packer_init (ClutterGstAtlasPacker *packer,
+                               gint size)
+{
+  packer->size = size;
+  packer->shelf_x = packer->shelf_y = packer->shelf_height = 0;
+}
 
-      vmeta = gst_buffer_get_video_meta (comp_buffer);
-      gst_video_meta_map (vmeta, 0, &info, &data, &stride, GST_MAP_READ);
+/* A pixel is left between rectangles, with the texture coordinates
+ * inset by half a texel that keeps filtering from bleeding into the
+ * neighbours */
+static gboolean
+clutter_gst_atlas_packer_add (ClutterGstAtlasPacker *packer,
+                              gint width,
+                              gint height,
+                              gint *x,
+                              gint *y)
+{
+  if (packer->shelf_x + width > packer->size)
+    {
+      packer->shelf_y += packer->shelf_height;
+      packer->shelf_x = 0;
+      packer->shelf_height = 0;
+    }
 
-      tex =
-        cogl_texture_2d_new_from_data (priv->ctx,
-                                       comp_width,
-                                       comp_height,
-                                       COGL_PIXEL_FORMAT_BGRA_8888,
-                                       stride, data,
-                                       &error);
+  if (packer->shelf_x + width > packer->size ||
+      packer->shelf_y + height > packer->size)
+    return FALSE;
 
-      gst_video_meta_unmap (vmeta, 0, &info);
+  *x = packer->shelf_x;
+  *y = packer->shelf_y;
 
-      if (tex != NULL)
-        {
-          ClutterGstOverlay *overlay = clutter_gst_overlay_new ();
+  packer->shelf_x += width + 1;
+  packer->shelf_height = MAX (packer->shelf_height, height + 1);
 
-          overlay->position.x1 = comp_x;
-          overlay->position.y1 = comp_y;
-          overlay->position.x2 = comp_x + comp_width;
-          overlay->position.y2 = comp_y + comp_height;
+  return TRUE;
+}
 
-          overlay->pipeline = cogl_pipeline_new (priv->ctx);
-          cogl_pipeline_set_layer_texture (overlay->pipeline, 0, tex);
+static gboolean
+clutter_gst_overlays_equal (ClutterGstOverlays *a,
+                            ClutterGstOverlays *b)
+{
+  guint i;
 
-          cogl_object_unref (tex);
+  if (a->pipeline != b->pipeline ||
+      a->overlays->len != b->overlays->len)
+    return FALSE;
 
-          g_ptr_array_add (priv->overlays->overlays, overlay);
-        }
-      else
-        {
-          GST_WARNING_OBJECT (sink,
-                              "Cannot upload overlay texture : %s",
-                              error->message);
-          cogl_error_free (error);
-        }
+  for (i = 0; i < a->overlays->len; i++)
+    {
+      ClutterGstOverlay *overlay_a = g_ptr_array_index (a->overlays, i);
+      ClutterGstOverlay *overlay_b = g_ptr_array_index (b->overlays, i);
+
+      if (overlay_a->pipeline != overlay_b->pipeline ||
+          memcmp (&overlay_a->position, &overlay_b->position,
+                  sizeof (ClutterGstBox)) != 0 ||
+          memcmp (&overlay_a->atlas_region, &overlay_b->atlas_region,
+                  sizeof (ClutterGstBox)) != 0)
+        return FALSE;
     }
 
-  g_signal_emit (sink, video_sink_signals[NEW_OVERLAYS], 0);
+  return TRUE;
 }
 
-/* Snippet cache */
-
-static SnippetCacheEntry *
-get_layer_cache_entry (ClutterGstVideoSink *sink,
-                       SnippetCache *cache)
+static void
+clutter_gst_atlas_entry_get_region (ClutterGstVideoSink *sink,
+                                    ClutterGstAtlasEntry *entry,
+                                    ClutterGstBox *region)
 {
-  ClutterGstVideoSinkPrivate *priv = sink->priv;
-  GList *l;
+  gfloat size = sink->priv->atlas_packer.size;
 
-  for (l = cache->entries.head; l; l = l->next)
+  /* The whole texture of a rectangle outside the atlas */
+  if (entry->texture)
     {
-      SnippetCacheEntry *entry = l->data;
-
-      if (entry->start_position == priv->video_start)
-        return entry;
+      region->x1 = region->y1 = 0.0f;
+      region->x2 = region->y2 = 1.0f;
+      return;
     }
 
-  return NULL;
+  region->x1 = (entry->x + 0.5f) / size;
+  region->y1 = (entry->y + 0.5f) / size;
+  region->x2 = (entry->x + entry->width - 0.5f) / size;
+  region->y2 = (entry->y + entry->height - 0.5f) / size;
 }
 
-static SnippetCacheEntry *
-add_layer_cache_entry (ClutterGstVideoSink *sink,
-                       SnippetCache *cache,
-                       const char *decl)
+/* Has the pipeline of @entry sample its region of the atlas, oriented
+ * like the frame */
+static void
+clutter_gst_atlas_entry_set_orientation (ClutterGstVideoSink *sink,
+                                         ClutterGstAtlasEntry *entry,
+                                         ClutterGstVideoOrientation orientation)
+{
+  ClutterGstBox region;
+  CoglMatrix matrix, oriented;
+
+  clutter_gst_atlas_entry_get_region (sink, entry, &region);
+  cogl_matrix_init_identity (&matrix);
+  cogl_matrix_translate (&matrix, region.x1, region.y1, 0.0f);
+  cogl_matrix_scale (&matrix,
+                     region.x2 - region.x1, region.y2 - region.y1, 1.0f);
+
+  clutter_gst_orientation_get_matrix (orientation, &oriented);
+  cogl_matrix_multiply (&matrix, &matrix, &oriented);
+
+  cogl_pipeline_set_layer_matrix (entry->pipeline, 0, &matrix);
+  entry->orientation = orientation;
+}
+
+/* Gives a rectangle that doesn't fit in the atlas a texture of its own */
+static ClutterGstAtlasEntry *
+clutter_gst_video_sink_upload_standalone_overlay (ClutterGstVideoSink *sink,
+                                                  GstVideoMeta *vmeta)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  SnippetCacheEntry *entry = g_slice_new (SnippetCacheEntry);
-  char *default_source;
+  ClutterGstAtlasEntry *entry;
+  CoglTexture *texture;
+  CoglError *error = NULL;
+  GstMapInfo info;
+  gpointer data;
+  gint stride;
 
-  entry->start_position = priv->video_start;
+  gst_video_meta_map (vmeta, 0, &info, &data, &stride, GST_MAP_READ);
 
-  entry->vertex_snippet =
-    cogl_snippet_new (COGL_SNIPPET_HOOK_VERTEX_GLOBALS,
-                      decl,
-                      NULL /* post */);
-  entry->fragment_snippet =
-    cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT_GLOBALS,
-                      decl,
-                      NULL /* post */);
+  texture =
+    COGL_TEXTURE (cogl_texture_2d_new_from_data (priv->ctx,
+                                                 vmeta->width, vmeta->height,
+                                                 COGL_PIXEL_FORMAT_BGRA_8888_PRE,
+                                                 stride, data,
+                                                 &error));
 
-  default_source =
-    g_strdup_printf ("  cogl_layer *= clutter_gst_sample_video%i "
-                     "(cogl_tex_coord%i_in.st);\n",
-                     priv->video_start,
-                     priv->video_start);
-  entry->default_sample_snippet =
-    cogl_snippet_new (COGL_SNIPPET_HOOK_LAYER_FRAGMENT,
-                      NULL, /* declarations */
-                      default_source);
-  g_free (default_source);
+  gst_video_meta_unmap (vmeta, 0, &info);
 
-  g_queue_push_head (&cache->entries, entry);
+  if (texture == NULL)
+    {
+      GST_WARNING_OBJECT (sink, "Cannot upload overlay texture : %s",
+                          error->message);
+      cogl_error_free (error);
+      return NULL;
+    }
+
+  GST_DEBUG_OBJECT (sink, "%ix%i overlay doesn't fit in the atlas",
+                    vmeta->width, vmeta->height);
+
+  entry = g_slice_new (ClutterGstAtlasEntry);
+  entry->x = entry->y = 0;
+  entry->width = vmeta->width;
+  entry->height = vmeta->height;
+  entry->texture = texture;
+  entry->pipeline = cogl_pipeline_new (priv->ctx);
+  cogl_pipeline_set_layer_texture (entry->pipeline, 0, texture);
+  cogl_pipeline_set_layer_wrap_mode (entry->pipeline, 0,
+                                     COGL_PIPELINE_WRAP_MODE_CLAMP_TO_EDGE);
+  clutter_gst_atlas_entry_set_orientation (sink, entry,
+                                           CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY);
 
   return entry;
 }
 
-static SnippetCacheEntry *
-get_global_cache_entry (SnippetCache *cache, int param)
+/* Uploads @rectangle into the atlas. If it doesn't fit, it gets a
+ * texture of its own when @standalone is %TRUE, %NULL is returned
+ * otherwise. */
+static ClutterGstAtlasEntry *
+clutter_gst_video_sink_upload_overlay_rectangle (ClutterGstVideoSink *sink,
+                                                 GstVideoOverlayRectangle *rectangle,
+                                                 gboolean standalone)
 {
-  GList *l;
-
-  for (l = cache->entries.head; l; l = l->next)
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstAtlasEntry *entry;
+  GstBuffer *comp_buffer;
+  GstMapInfo info;
+  GstVideoMeta *vmeta;
+  gpointer data;
+  gint stride, x, y;
+  gboolean uploaded;
+  CoglBitmap *bitmap;
+
+  comp_buffer =
+    gst_video_overlay_rectangle_get_pixels_unscaled_argb (rectangle,
+                                                          GST_VIDEO_OVERLAY_FORMAT_FLAG_PREMULTIPLIED_ALPHA);
+  vmeta = gst_buffer_get_video_meta (comp_buffer);
+
+  if (priv->atlas == NULL ||
+      !clutter_gst_atlas_packer_add (&priv->atlas_packer,
+                                     vmeta->width, vmeta->height, &x, &y))
     {
-      SnippetCacheEntry *entry = l->data;
+      if (standalone)
+        return clutter_gst_video_sink_upload_standalone_overlay (sink, vmeta);
 
-      if (entry->start_position == param)
-        return entry;
+      return NULL;
     }
 
-  return NULL;
-}
+  gst_video_meta_map (vmeta, 0, &info, &data, &stride, GST_MAP_READ);
 
-static SnippetCacheEntry *
-add_global_cache_entry (SnippetCache *cache,
-                        const char *decl,
-                        int param)
-{
-  SnippetCacheEntry *entry = g_slice_new (SnippetCacheEntry);
+  bitmap = cogl_bitmap_new_for_data (priv->ctx,
+                                     vmeta->width, vmeta->height,
+                                     COGL_PIXEL_FORMAT_BGRA_8888_PRE,
+                                     stride, data);
+  uploaded = cogl_texture_set_region_from_bitmap (priv->atlas,
+                                                  0, 0, x, y,
+                                                  vmeta->width,
+                                                  vmeta->height,
+                                                  bitmap);
+  cogl_object_unref (bitmap);
 
-  entry->start_position = param;
+  gst_video_meta_unmap (vmeta, 0, &info);
 
-  entry->vertex_snippet =
-    cogl_snippet_new (COGL_SNIPPET_HOOK_VERTEX_GLOBALS,
-                      decl,
-                      NULL /* post */);
-  entry->fragment_snippet =
-    cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT_GLOBALS,
-                      decl,
-                      NULL /* post */);
+  if (!uploaded)
+    {
+      GST_WARNING_OBJECT (sink, "Cannot upload overlay texture");
+      return NULL;
+    }
 
-  g_queue_push_head (&cache->entries, entry);
+  entry = g_slice_new (ClutterGstAtlasEntry);
+  entry->x = x;
+  entry->y = y;
+  entry->width = vmeta->width;
+  entry->height = vmeta->height;
+  entry->texture = NULL;
+  entry->pipeline = cogl_pipeline_copy (priv->atlas_pipeline);
+  clutter_gst_atlas_entry_set_orientation (sink, entry,
+                                           CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY);
 
   return entry;
 }
 
-static void
-setup_pipeline_from_cache_entry (ClutterGstVideoSink *sink,
-                                 CoglPipeline *pipeline,
-                                 SnippetCacheEntry *cache_entry,
-                                 int n_layers)
+/* Allocates a new atlas, the smallest the rectangles of the composition
+ * fit in, or the largest one Cogl can allocate. Sizes it fails to
+ * allocate are not tried again. The previous atlas is never reused:
+ * the overlays handed out keep sampling it through their pipelines,
+ * and it must not be overwritten under them. */
+static gboolean
+clutter_gst_video_sink_resize_atlas (ClutterGstVideoSink *sink,
+                                     GstVideoOverlayComposition *composition)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstAtlasPacker packer;
+  guint i, n_rectangles;
+  gint size, x, y;
+  CoglError *error = NULL;
 
-  if (cache_entry)
+  n_rectangles = gst_video_overlay_composition_n_rectangles (composition);
+
+  for (size = MAX (priv->atlas_packer.size, OVERLAY_ATLAS_MIN_SIZE);
+       size < priv->atlas_max_size;
+       size *= 2)
     {
-      int i;
+      clutter_gst_atlas_packer_init (&packer, size);
 
-      /* The global sampling function gets added to both the fragment
-       * and vertex stages. The hope is that the GLSL compiler will
-       * easily remove the dead code if it's not actually used */
-      cogl_pipeline_add_snippet (pipeline, cache_entry->vertex_snippet);
-      cogl_pipeline_add_snippet (pipeline, cache_entry->fragment_snippet);
+      for (i = 0; i < n_rectangles; i++)
+        {
+          GstVideoOverlayRectangle *rectangle =
+            gst_video_overlay_composition_get_rectangle (composition, i);
+          GstBuffer *comp_buffer =
+            gst_video_overlay_rectangle_get_pixels_unscaled_argb (rectangle,
+                                                                  GST_VIDEO_OVERLAY_FORMAT_FLAG_PREMULTIPLIED_ALPHA);
+          GstVideoMeta *vmeta = gst_buffer_get_video_meta (comp_buffer);
+
+          if (!clutter_gst_atlas_packer_add (&packer, vmeta->width,
+                                             vmeta->height, &x, &y))
+            break;
+        }
+
+      if (i == n_rectangles)
+        break;
+    }
+
+  g_clear_pointer (&priv->atlas, cogl_object_unref);
+  g_clear_pointer (&priv->atlas_pipeline, cogl_object_unref);
+
+  while (TRUE)
+    {
+      GST_DEBUG_OBJECT (sink, "allocating a %ix%i overlay atlas", size, size);
+
+      priv->atlas =
+        COGL_TEXTURE (cogl_texture_2d_new_with_size (priv->ctx, size, size));
+      if (cogl_texture_allocate (priv->atlas, &error))
+        break;
+
+      GST_DEBUG_OBJECT (sink, "Cannot allocate a %ix%i overlay atlas : %s",
+                        size, size, error->message);
+      cogl_error_free (error);
+      error = NULL;
+      g_clear_pointer (&priv->atlas, cogl_object_unref);
+
+      /* Likely past the maximum texture size of the GPU */
+      if (size <= OVERLAY_ATLAS_MIN_SIZE)
+        {
+          GST_WARNING_OBJECT (sink, "Cannot allocate an overlay atlas");
+          priv->atlas_packer.size = 0;
+          return FALSE;
+        }
+
+      size /= 2;
+      priv->atlas_max_size = size;
+    }
+
+  clutter_gst_atlas_packer_init (&priv->atlas_packer, size);
+
+  priv->atlas_pipeline = cogl_pipeline_new (priv->ctx);
+  cogl_pipeline_set_layer_texture (priv->atlas_pipeline, 0, priv->atlas);
+  cogl_pipeline_set_layer_wrap_mode (priv->atlas_pipeline, 0,
+                                     COGL_PIPELINE_WRAP_MODE_CLAMP_TO_EDGE);
+
+  return TRUE;
+}
+
+/* Fills @overlay_cache with the entries of the rectangles of
+ * @composition, returns %FALSE if some of them couldn't be placed. The
+ * rectangles that don't fit in the atlas get textures of their own if
+ * @standalone is %TRUE. */
+static gboolean
+clutter_gst_video_sink_pack_overlays (ClutterGstVideoSink *sink,
+                                      GstVideoOverlayComposition *composition,
+                                      GHashTable *overlay_cache,
+                                      gboolean standalone)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  gboolean complete = TRUE;
+  guint i, nb_rectangle;
+
+  nb_rectangle = gst_video_overlay_composition_n_rectangles (composition);
+  for (i = 0; i < nb_rectangle; i++)
+    {
+      GstVideoOverlayRectangle *rectangle;
+      ClutterGstAtlasEntry *entry;
+      gpointer seqnum;
+
+      rectangle = gst_video_overlay_composition_get_rectangle (composition, i);
+      seqnum =
+        GUINT_TO_POINTER (gst_video_overlay_rectangle_get_seqnum (rectangle));
+
+      if (g_hash_table_contains (overlay_cache, seqnum))
+        continue;
+
+      entry = g_hash_table_lookup (priv->overlay_cache, seqnum);
+      if (entry != NULL)
+        g_hash_table_steal (priv->overlay_cache, seqnum);
+      else
+        entry = clutter_gst_video_sink_upload_overlay_rectangle (sink,
+                                                                 rectangle,
+                                                                 standalone);
+
+      if (entry == NULL)
+        {
+          complete = FALSE;
+          continue;
+        }
+
+      g_hash_table_insert (overlay_cache, seqnum, entry);
+    }
+
+  return complete;
+}
+
+static void
+clutter_gst_video_sink_upload_overlay (ClutterGstVideoSink *sink, GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  GstVideoOverlayComposition *composition = NULL;
+  GstVideoOverlayCompositionMeta *composition_meta;
+  ClutterGstOverlays *overlays;
+  GHashTable *overlay_cache;
+  guint i, nb_rectangle;
+  gint frame_width, frame_height;
+
+  composition_meta = gst_buffer_get_video_overlay_composition_meta (buffer);
+  if (composition_meta)
+    composition = composition_meta->overlay;
+
+  if (composition == NULL)
+    {
+      if (priv->last_composition != NULL)
+        {
+          gst_video_overlay_composition_unref (priv->last_composition);
+          priv->last_composition = NULL;
+          g_hash_table_remove_all (priv->overlay_cache);
+
+          /* The next composition gets a new atlas of the same size */
+          g_clear_pointer (&priv->atlas, cogl_object_unref);
+          g_clear_pointer (&priv->atlas_pipeline, cogl_object_unref);
+
+          if (priv->overlays)
+            clutter_gst_overlays_unref (priv->overlays);
+          priv->overlays = clutter_gst_overlays_new ();
+
+          g_signal_emit (sink, video_sink_signals[NEW_OVERLAYS], 0);
+        }
+      return;
+    }
+
+  /* Most buffers carry the composition of the previous one */
+  if (priv->last_composition != NULL &&
+      gst_video_overlay_composition_get_seqnum (priv->last_composition) ==
+      gst_video_overlay_composition_get_seqnum (composition) &&
+      priv->overlays_orientation == priv->orientation)
+    return;
+
+  /* Without an atlas, the rectangles get textures of their own below */
+  if (priv->atlas == NULL)
+    clutter_gst_video_sink_resize_atlas (sink, composition);
+
+  /* The entries of rectangles that are still around are moved to the
+   * new cache, the others are released with the old one */
+  overlay_cache =
+    g_hash_table_new_full (NULL, NULL, NULL,
+                           (GDestroyNotify) clutter_gst_atlas_entry_free);
+
+  if (!clutter_gst_video_sink_pack_overlays (sink, composition,
+                                             overlay_cache, FALSE))
+    {
+      /* Start over with an atlas holding this composition only */
+      g_hash_table_remove_all (overlay_cache);
+      g_hash_table_remove_all (priv->overlay_cache);
+
+      clutter_gst_video_sink_resize_atlas (sink, composition);
+      if (!clutter_gst_video_sink_pack_overlays (sink, composition,
+                                                 overlay_cache, TRUE))
+        {
+          /* Nothing is shown rather than stale overlays. The
+           * composition isn't recorded, so that the next buffers
+           * carrying it try again. */
+          GST_WARNING_OBJECT (sink, "Cannot upload the overlays");
+          g_hash_table_unref (priv->overlay_cache);
+          priv->overlay_cache = overlay_cache;
+          g_clear_pointer (&priv->last_composition,
+                           gst_video_overlay_composition_unref);
+
+          if (priv->overlays)
+            clutter_gst_overlays_unref (priv->overlays);
+          priv->overlays = clutter_gst_overlays_new ();
+
+          g_signal_emit (sink, video_sink_signals[NEW_OVERLAYS], 0);
+          return;
+        }
+    }
+
+  g_hash_table_unref (priv->overlay_cache);
+  priv->overlay_cache = overlay_cache;
+
+  g_clear_pointer (&priv->last_composition, gst_video_overlay_composition_unref);
+  priv->last_composition = gst_video_overlay_composition_ref (composition);
+
+  /* The overlays are handed out as displayed: their positions are
+   * rotated and flipped like the frame, and so are their atlas regions,
+   * the atlas pipeline swapping the texture coordinates for the
+   * rotations */
+  if (priv->crop_width > 0 && priv->crop_height > 0)
+    {
+      frame_width = priv->crop_width;
+      frame_height = priv->crop_height;
+    }
+  else
+    {
+      frame_width = GST_VIDEO_INFO_WIDTH (&priv->info);
+      frame_height = GST_VIDEO_INFO_HEIGHT (&priv->info);
+    }
+
+  overlays = clutter_gst_overlays_new ();
+  if (priv->atlas_pipeline)
+    {
+      CoglMatrix matrix;
+
+      if (clutter_gst_orientation_transposes (priv->orientation))
+        clutter_gst_orientation_get_matrix (CLUTTER_GST_VIDEO_ORIENTATION_UL_LR,
+                                            &matrix);
+      else
+        cogl_matrix_init_identity (&matrix);
+
+      cogl_pipeline_set_layer_matrix (priv->atlas_pipeline, 0, &matrix);
+      overlays->pipeline = cogl_object_ref (priv->atlas_pipeline);
+    }
+  priv->overlays_orientation = priv->orientation;
+
+  nb_rectangle = gst_video_overlay_composition_n_rectangles (composition);
+  for (i = 0; i < nb_rectangle; i++)
+    {
+      GstVideoOverlayRectangle *rectangle;
+      ClutterGstAtlasEntry *entry;
+      gint comp_x, comp_y;
+      guint comp_width, comp_height;
+      ClutterGstOverlay *overlay;
+      ClutterGstBox position, region;
+
+      rectangle = gst_video_overlay_composition_get_rectangle (composition, i);
+      entry =
+        g_hash_table_lookup (overlay_cache,
+                             GUINT_TO_POINTER (gst_video_overlay_rectangle_get_seqnum (rectangle)));
+      if (entry == NULL)
+        continue;
+
+      gst_video_overlay_rectangle_get_render_rectangle (rectangle,
+                                                        &comp_x, &comp_y, &comp_width, &comp_height);
+
+      if (entry->orientation != priv->orientation)
+        clutter_gst_atlas_entry_set_orientation (sink, entry, priv->orientation);
+
+      overlay = clutter_gst_overlay_new ();
+
+      position.x1 = comp_x;
+      position.y1 = comp_y;
+      position.x2 = comp_x + comp_width;
+      position.y2 = comp_y + comp_height;
+      clutter_gst_orientation_map_box (priv->orientation,
+                                       frame_width, frame_height,
+                                       &position, &overlay->position);
+
+      clutter_gst_atlas_entry_get_region (sink, entry, &region);
+      if (entry->texture)
+        {
+          /* Painted on its own, its pipeline applies the orientation */
+          overlay->atlas_region = region;
+        }
+      else
+        {
+          clutter_gst_orientation_map_region (priv->orientation, &region,
+                                              &overlay->atlas_region);
+          overlay->in_atlas = TRUE;
+        }
+
+      overlay->pipeline = cogl_object_ref (entry->pipeline);
+
+      g_ptr_array_add (overlays->overlays, overlay);
+    }
+
+  /* A new composition doesn't necessarily change what is displayed */
+  if (priv->overlays && clutter_gst_overlays_equal (priv->overlays, overlays))
+    {
+      clutter_gst_overlays_unref (overlays);
+      return;
+    }
+
+  if (priv->overlays)
+    clutter_gst_overlays_unref (priv->overlays);
+  priv->overlays = overlays;
+
+  g_signal_emit (sink, video_sink_signals[NEW_OVERLAYS], 0);
+}
+
+/* Snippet cache */
+
+static SnippetCacheEntry *
+get_layer_cache_entry (ClutterGstVideoSink *sink,
+                       SnippetCache *cache)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GList *l;
+
+  for (l = cache->entries.head; l; l = l->next)
+    {
+      SnippetCacheEntry *entry = l->data;
+
+      if (entry->start_position == priv->video_start)
+        return entry;
+    }
+
+  return NULL;
+}
+
+static SnippetCacheEntry *
+add_layer_cache_entry (ClutterGstVideoSink *sink,
+                       SnippetCache *cache,
+                       const char *decl)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  SnippetCacheEntry *entry = g_slice_new (SnippetCacheEntry);
+  char *default_source;
+
+  entry->start_position = priv->video_start;
+
+  entry->vertex_snippet =
+    cogl_snippet_new (COGL_SNIPPET_HOOK_VERTEX_GLOBALS,
+                      decl,
+                      NULL /* post */);
+  entry->fragment_snippet =
+    cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT_GLOBALS,
+                      decl,
+                      NULL /* post */);
+
+  default_source =
+    g_strdup_printf ("  cogl_layer *= clutter_gst_sample_video%i "
+                     "(cogl_tex_coord%i_in.st);\n",
+                     priv->video_start,
+                     priv->video_start);
+  entry->default_sample_snippet =
+    cogl_snippet_new (COGL_SNIPPET_HOOK_LAYER_FRAGMENT,
+                      NULL, /* declarations */
+                      default_source);
+  g_free (default_source);
+
+  g_queue_push_head (&cache->entries, entry);
+
+  return entry;
+}
+
+static SnippetCacheEntry *
+get_global_cache_entry (SnippetCache *cache, int param)
+{
+  GList *l;
+
+  for (l = cache->entries.head; l; l = l->next)
+    {
+      SnippetCacheEntry *entry = l->data;
+
+      if (entry->start_position == param)
+        return entry;
+    }
+
+  return NULL;
+}
+
+static SnippetCacheEntry *
+add_global_cache_entry (SnippetCache *cache,
+                        const char *decl,
+                        int param)
+{
+  SnippetCacheEntry *entry = g_slice_new (SnippetCacheEntry);
+
+  entry->start_position = param;
+
+  entry->vertex_snippet =
+    cogl_snippet_new (COGL_SNIPPET_HOOK_VERTEX_GLOBALS,
+                      decl,
+                      NULL /* post */);
+  entry->fragment_snippet =
+    cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT_GLOBALS,
+                      decl,
+                      NULL /* post */);
+
+  g_queue_push_head (&cache->entries, entry);
+
+  return entry;
+}
+
+static void
+setup_pipeline_from_cache_entry (ClutterGstVideoSink *sink,
+                                 CoglPipeline *pipeline,
+                                 SnippetCacheEntry *cache_entry,
+                                 int n_layers)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  if (cache_entry)
+    {
+      int i;
+
+      /* The global sampling function gets added to both the fragment
+       * and vertex stages. The hope is that the GLSL compiler will
+       * easily remove the dead code if it's not actually used */
+      cogl_pipeline_add_snippet (pipeline, cache_entry->vertex_snippet);
+      cogl_pipeline_add_snippet (pipeline, cache_entry->fragment_snippet);
 
       /* Set all of the layers to just directly copy from the previous
        * layer so that it won't redundantly generate code to sample
@@ -499,57 +1486,6 @@ setup_pipeline_from_cache_entry (ClutterGstVideoSink *sink,
 #define DEFAULT_HUE        (0.0f)
 #define DEFAULT_SATURATION (1.0f)
 
-static gboolean
-clutter_gst_video_sink_needs_color_balance_shader (ClutterGstVideoSink *sink)
-{
-  ClutterGstVideoSinkPrivate *priv = sink->priv;
-
-  return (priv->brightness != DEFAULT_BRIGHTNESS ||
-          priv->contrast != DEFAULT_CONTRAST ||
-          priv->hue != DEFAULT_HUE ||
-          priv->saturation != DEFAULT_SATURATION);
-}
-
-static void
-clutter_gst_video_sink_color_balance_update_tables (ClutterGstVideoSink *sink)
-{
-  ClutterGstVideoSinkPrivate *priv = sink->priv;
-  gint i, j;
-  gdouble y, u, v, hue_cos, hue_sin;
-
-  /* Y */
-  for (i = 0; i < 256; i++) {
-    y = 16 + ((i - 16) * priv->contrast + priv->brightness * 255);
-    if (y < 0)
-      y = 0;
-    else if (y > 255)
-      y = 255;
-    priv->tabley[i] = rint (y);
-  }
-
-  hue_cos = cos (G_PI * priv->hue);
-  hue_sin = sin (G_PI * priv->hue);
-
-  /* U/V lookup tables are 2D, since we need both U/V for each table
-   * separately. */
-  for (i = -128; i < 128; i++) {
-    for (j = -128; j < 128; j++) {
-      u = 128 + ((i * hue_cos + j * hue_sin) * priv->saturation);
-      v = 128 + ((-i * hue_sin + j * hue_cos) * priv->saturation);
-      if (u < 0)
-        u = 0;
-      else if (u > 255)
-        u = 255;
-      if (v < 0)
-        v = 0;
-      else if (v > 255)
-        v = 255;
-      priv->tableu[(i + 128) * 256 + j + 128] = rint (u);
-      priv->tablev[(i + 128) * 256 + j + 128] = rint (v);
-    }
-  }
-}
-
 static const GList *
 clutter_gst_video_sink_color_balance_list_channels (GstColorBalance *balance)
 {
@@ -698,24 +1634,351 @@ clutter_gst_video_sink_navigation_send_event (GstNavigation *navigation,
 }
 
 static void
-navigation_interface_init (GstNavigationInterface * iface)
+navigation_interface_init (GstNavigationInterface * iface)
+{
+  iface->send_event = clutter_gst_video_sink_navigation_send_event;
+}
+
+/**/
+
+static void
+clutter_gst_timing_add (ClutterGstTiming *timing,
+                        GstClockTime value)
+{
+  if (timing->count == 0 || value < timing->min)
+    timing->min = value;
+  if (value > timing->max)
+    timing->max = value;
+
+  timing->total += value;
+  timing->count++;
+}
+
+static GstStructure *
+clutter_gst_timing_to_structure (ClutterGstTiming *timing,
+                                 const gchar *name)
+{
+  return gst_structure_new (name,
+                            "count", G_TYPE_UINT64, timing->count,
+                            "min", G_TYPE_UINT64, timing->min,
+                            "average", G_TYPE_UINT64, timing->count ?
+                            timing->total / timing->count : 0,
+                            "max", G_TYPE_UINT64, timing->max,
+                            NULL);
+}
+
+static void
+clutter_gst_queued_frame_clear (ClutterGstQueuedFrame *frame)
+{
+  gst_buffer_replace (&frame->buffer, NULL);
+  gst_caps_replace (&frame->caps, NULL);
+}
+
+static inline guint
+clutter_gst_source_n_queued (ClutterGstSource *gst_source)
+{
+  return (guint) g_atomic_int_get (&gst_source->head) -
+    (guint) g_atomic_int_get (&gst_source->tail);
+}
+
+/* Posts a QoS message for a frame that never made it to the screen */
+static void
+clutter_gst_video_sink_post_dropped (ClutterGstVideoSink *sink,
+                                     GstClockTime pts,
+                                     GstClockTime running_time,
+                                     GstClockTime duration)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstBaseSink *bsink = GST_BASE_SINK (sink);
+  GstClockTime stream_time;
+  GstMessage *message;
+  gdouble proportion;
+  guint64 dropped;
+
+  if (!g_atomic_int_get (&priv->qos_enabled))
+    return;
+
+  GST_OBJECT_LOCK (sink);
+  stream_time = gst_segment_to_stream_time (&bsink->segment, GST_FORMAT_TIME,
+                                            pts);
+  proportion = priv->qos_proportion;
+  GST_OBJECT_UNLOCK (sink);
+
+  dropped = (guint) g_atomic_int_get (&priv->stats.dropped) +
+    (guint) g_atomic_int_get (&priv->stats.overflowed);
+
+  message = gst_message_new_qos (GST_OBJECT (sink), FALSE, running_time,
+                                 stream_time, pts, duration);
+  gst_message_set_qos_values (message, 0, proportion, 1000000);
+  gst_message_set_qos_stats (message, GST_FORMAT_BUFFERS,
+                             (guint) g_atomic_int_get (&priv->stats.uploaded),
+                             dropped);
+  gst_element_post_message (GST_ELEMENT (sink), message);
+}
+
+/* Called from the streaming thread. Returns FALSE if the main loop is
+ * too far behind for the frame to be queued. */
+static gboolean
+clutter_gst_source_push_frame (ClutterGstSource *gst_source,
+                               GstBuffer *buffer,
+                               GstClockTime running_time)
+{
+  ClutterGstQueuedFrame *frame;
+  guint head = g_atomic_int_get (&gst_source->head);
+
+  if (head - (guint) g_atomic_int_get (&gst_source->tail) >=
+      CLUTTER_GST_FRAME_QUEUE_SIZE)
+    return FALSE;
+
+  frame = &gst_source->frames[head & (CLUTTER_GST_FRAME_QUEUE_SIZE - 1)];
+  frame->buffer = gst_buffer_ref (buffer);
+  frame->pts = GST_BUFFER_PTS (buffer);
+  frame->queued_time = g_get_monotonic_time ();
+  frame->running_time = running_time;
+  frame->duration = GST_BUFFER_DURATION (buffer);
+  frame->caps = gst_source->pending_caps;
+  frame->flush_seqnum = g_atomic_int_get (&gst_source->flush_seqnum);
+  gst_source->pending_caps = NULL;
+
+  /* Publish the slot */
+  g_atomic_int_set (&gst_source->head, head + 1);
+
+  return TRUE;
+}
+
+/* Called from the main loop. Empties the queue up to the frames with a
+ * running time after @deadline, returning the last caps dequeued (if
+ * any) in @caps and the frame to present, with its timing copied into
+ * @popped, the other frames are dropped. The first frame is always
+ * taken until a frame has been uploaded. */
+static GstBuffer *
+clutter_gst_source_pop_frame (ClutterGstSource *gst_source,
+                              GstCaps **caps,
+                              ClutterGstQueuedFrame *popped,
+                              GstClockTime deadline)
+{
+  ClutterGstVideoSinkPrivate *priv = gst_source->sink->priv;
+  GstBuffer *buffer = NULL;
+  gint flush_seqnum = g_atomic_int_get (&gst_source->flush_seqnum);
+  guint head = g_atomic_int_get (&gst_source->head);
+  guint tail = g_atomic_int_get (&gst_source->tail);
+
+  *caps = NULL;
+
+  for (; tail != head; tail++)
+    {
+      ClutterGstQueuedFrame *frame =
+        &gst_source->frames[tail & (CLUTTER_GST_FRAME_QUEUE_SIZE - 1)];
+
+      if (GST_CLOCK_TIME_IS_VALID (deadline) &&
+          (buffer != NULL || priv->had_upload_once) &&
+          frame->flush_seqnum == flush_seqnum &&
+          GST_CLOCK_TIME_IS_VALID (frame->running_time) &&
+          frame->running_time > deadline)
+        {
+          GST_LOG_OBJECT (gst_source->sink, "Keeping buffer %p with running "
+                          "time %" GST_TIME_FORMAT " for a later vblank",
+                          frame->buffer, GST_TIME_ARGS (frame->running_time));
+          break;
+        }
+
+      /* Caps apply even if the frame they came with got flushed */
+      if (frame->caps)
+        {
+          gst_caps_replace (caps, NULL);
+          *caps = frame->caps;
+          frame->caps = NULL;
+        }
+
+      if (frame->flush_seqnum != flush_seqnum)
+        {
+          GST_DEBUG_OBJECT (gst_source->sink, "Discarding flushed buffer %p",
+                            frame->buffer);
+          clutter_gst_queued_frame_clear (frame);
+          continue;
+        }
+
+      if (buffer)
+        {
+          GST_DEBUG_OBJECT (gst_source->sink,
+                            "Dropping buffer %p, newer frames are queued",
+                            buffer);
+          gst_buffer_unref (buffer);
+          g_atomic_int_inc (&priv->stats.dropped);
+          clutter_gst_video_sink_post_dropped (gst_source->sink, popped->pts,
+                                               popped->running_time,
+                                               popped->duration);
+        }
+
+      GST_LOG_OBJECT (gst_source->sink, "Dequeued buffer %p with pts %"
+                      GST_TIME_FORMAT, frame->buffer,
+                      GST_TIME_ARGS (frame->pts));
+      buffer = frame->buffer;
+      popped->pts = frame->pts;
+      popped->queued_time = frame->queued_time;
+      popped->running_time = frame->running_time;
+      popped->duration = frame->duration;
+      popped->flush_seqnum = frame->flush_seqnum;
+      frame->buffer = NULL;
+    }
+
+  /* Give the slots back to the streaming thread */
+  g_atomic_int_set (&gst_source->tail, tail);
+
+  return buffer;
+}
+
+static void
+clutter_gst_source_finalize (GSource *source)
+{
+  ClutterGstSource *gst_source = (ClutterGstSource *) source;
+  guint i;
+
+  for (i = 0; i < CLUTTER_GST_FRAME_QUEUE_SIZE; i++)
+    clutter_gst_queued_frame_clear (&gst_source->frames[i]);
+
+  gst_caps_replace (&gst_source->pending_caps, NULL);
+}
+
+/* Crop
+ *
+ * Frames are uploaded whole, padding included, the part to display is
+ * selected with the texture matrix of the video layers. That part is
+ * given by the GstVideoCropMeta of the buffer, or is the size in the
+ * caps when a GstVideoMeta describes a larger frame. */
+
+/* Returns TRUE if the visible part of the frame changed */
+static gboolean
+clutter_gst_video_sink_update_crop (ClutterGstVideoSink *sink,
+                                    GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstVideoCropMeta *crop_meta = gst_buffer_get_video_crop_meta (buffer);
+  GstVideoMeta *video_meta = gst_buffer_get_video_meta (buffer);
+  gint width = GST_VIDEO_INFO_WIDTH (&priv->info);
+  gint height = GST_VIDEO_INFO_HEIGHT (&priv->info);
+  gint x = 0, y = 0, crop_width = width, crop_height = height;
+  ClutterGstBox region;
+
+  if (video_meta)
+    {
+      width = video_meta->width;
+      height = video_meta->height;
+    }
+
+  if (crop_meta && crop_meta->width > 0 && crop_meta->height > 0)
+    {
+      x = MIN (crop_meta->x, width - 1);
+      y = MIN (crop_meta->y, height - 1);
+      crop_width = crop_meta->width;
+      crop_height = crop_meta->height;
+    }
+
+  crop_width = MIN (crop_width, width - x);
+  crop_height = MIN (crop_height, height - y);
+
+  if (width <= 0 || height <= 0 || crop_width <= 0 || crop_height <= 0)
+    return FALSE;
+
+  region.x1 = (gfloat) x / width;
+  region.y1 = (gfloat) y / height;
+  region.x2 = (gfloat) (x + crop_width) / width;
+  region.y2 = (gfloat) (y + crop_height) / height;
+
+  if (memcmp (&region, &priv->crop_region, sizeof (region)) == 0 &&
+      crop_width == priv->crop_width && crop_height == priv->crop_height)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (sink, "displaying %ix%i at %i,%i of %ix%i frames",
+                    crop_width, crop_height, x, y, width, height);
+
+  priv->crop_region = region;
+  priv->crop_width = crop_width;
+  priv->crop_height = crop_height;
+  priv->texture_matrix_dirty = TRUE;
+
+  /* Frames handed out are not modified, a new one with the resolution
+   * of the crop is created when asked for */
+  if (priv->clt_frame)
+    {
+      clutter_gst_frame_unref (priv->clt_frame);
+      priv->clt_frame = NULL;
+    }
+
+  return TRUE;
+}
+
+/* Returns TRUE if the orientation of the frame changed */
+static gboolean
+clutter_gst_video_sink_update_orientation (ClutterGstVideoSink *sink,
+                                           GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstVideoOrientation orientation;
+#if GST_CHECK_VERSION (1, 8, 0)
+  GstVideoAffineTransformationMeta *meta;
+#endif
+
+  orientation = g_atomic_int_get (&priv->tag_orientation);
+
+#if GST_CHECK_VERSION (1, 8, 0)
+  meta = gst_buffer_get_video_affine_transformation_meta (buffer);
+  if (meta)
+    {
+      gint affine = clutter_gst_orientation_from_affine_meta (meta);
+
+      if (affine >= 0)
+        orientation = clutter_gst_orientation_compose (affine, orientation);
+      else
+        GST_LOG_OBJECT (sink, "ignoring affine transformation of buffer %p, "
+                        "not a rotation or a flip", buffer);
+    }
+#endif
+
+  if (orientation == priv->orientation)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (sink, "orientation changed to %i", orientation);
+
+  priv->orientation = orientation;
+  priv->texture_matrix_dirty = TRUE;
+
+  /* Frames handed out are not modified, the orientation goes into a
+   * new one */
+  if (priv->clt_frame)
+    {
+      clutter_gst_frame_unref (priv->clt_frame);
+      priv->clt_frame = NULL;
+    }
+
+  return TRUE;
+}
+
+static void
+clutter_gst_video_sink_update_texture_matrix (ClutterGstVideoSink *sink,
+                                              CoglPipeline *pipeline)
 {
-  iface->send_event = clutter_gst_video_sink_navigation_send_event;
-}
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  const ClutterGstBox *region = &priv->crop_region;
+  CoglMatrix matrix, orientation;
+  guint i;
 
-/**/
+  cogl_matrix_init_identity (&matrix);
 
-static void
-clutter_gst_source_finalize (GSource *source)
-{
-  ClutterGstSource *gst_source = (ClutterGstSource *) source;
+  /* Nothing uploaded yet */
+  if (priv->crop_width > 0)
+    {
+      cogl_matrix_translate (&matrix, region->x1, region->y1, 0.0f);
+      cogl_matrix_scale (&matrix,
+                         region->x2 - region->x1, region->y2 - region->y1,
+                         1.0f);
+    }
 
-  g_mutex_lock (&gst_source->buffer_lock);
-  if (gst_source->buffer)
-    gst_buffer_unref (gst_source->buffer);
-  gst_source->buffer = NULL;
-  g_mutex_unlock (&gst_source->buffer_lock);
-  g_mutex_clear (&gst_source->buffer_lock);
+  clutter_gst_orientation_get_matrix (priv->orientation, &orientation);
+  cogl_matrix_multiply (&matrix, &matrix, &orientation);
+
+  for (i = 0; i < priv->renderer->n_layers; i++)
+    cogl_pipeline_set_layer_matrix (pipeline, priv->video_start + i, &matrix);
 }
 
 void
@@ -729,230 +1992,236 @@ clutter_gst_video_sink_attach_frame (ClutterGstVideoSink *sink,
     if (priv->frame[i] != NULL)
       cogl_pipeline_set_layer_texture (pln, i + priv->video_start,
                                        priv->frame[i]);
-}
 
-/* Color balance */
+  clutter_gst_video_sink_update_texture_matrix (sink, pln);
+}
 
-static const gchar *no_color_balance_shader =
-  "#define clutter_gst_get_corrected_color_from_yuv(arg) (arg)\n"
-  "#define clutter_gst_get_corrected_color_from_rgb(arg) (arg)\n";
+/* Color conversion
+ *
+ * The range expansion, the color balance and the conversion to RGB are
+ * folded into a single matrix applied to the (Y, U, V, 1) samples, or
+ * to the (R, G, B, 1) ones for RGB formats. Changing the balance then
+ * only updates a uniform of the pipeline. */
 
-static const gchar *color_balance_shader =
-  "vec3\n"
-  "clutter_gst_get_corrected_color_from_yuv (vec3 yuv)\n"
-  "{\n"
-  "  vec2 ruv = vec2 (yuv[2] + 0.5, yuv[1] + 0.5);\n"
-  "  return vec3 (texture2D (cogl_sampler%i, vec2 (yuv[0], 0)).a,\n"
-  "               texture2D (cogl_sampler%i, ruv).a - 0.5,\n"
-  "               texture2D (cogl_sampler%i, ruv).a - 0.5);\n"
-  "}\n"
+static const gchar *color_matrix_shader =
+  "uniform mat4 clutter_gst_color_matrix;\n"
   "\n"
   "vec3\n"
-  "clutter_gst_get_corrected_color_from_rgb (vec3 rgb)\n"
+  "clutter_gst_convert_color (vec3 color)\n"
   "{\n"
-  "  vec3 yuv = clutter_gst_yuv_srgb_to_bt601 (rgb);\n"
-  "  vec3 corrected_yuv = vec3 (texture2D (cogl_sampler%i, vec2 (yuv[0], 0)).a,\n"
-  "                             texture2D (cogl_sampler%i, vec2 (yuv[2], yuv[1])).a,\n"
-  "                             texture2D (cogl_sampler%i, vec2 (yuv[2], yuv[1])).a);\n"
-  "  return clutter_gst_yuv_bt601_to_srgb (corrected_yuv);\n"
+  "  return (clutter_gst_color_matrix * vec4 (color, 1.0)).rgb;\n"
   "}\n";
 
+/* Row major 4x4 matrices, a = a * b */
 static void
-clutter_gst_video_sink_setup_balance (ClutterGstVideoSink *sink,
-                                      CoglPipeline *pipeline)
+color_matrix_multiply (gdouble a[16],
+                       const gdouble b[16])
 {
-  ClutterGstVideoSinkPrivate *priv = sink->priv;
-  static SnippetCache snippet_cache;
-  static CoglSnippet *no_color_balance_snippet_vert = NULL,
-    *no_color_balance_snippet_frag = NULL;
+  gdouble tmp[16];
+  gint i, j, k;
+
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      {
+        tmp[i * 4 + j] = 0;
+        for (k = 0; k < 4; k++)
+          tmp[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
+      }
 
-  GST_INFO_OBJECT (sink, "attaching correction b=%.3f/c=%.3f/h=%.3f/s=%.3f",
-                   priv->brightness, priv->contrast,
-                   priv->hue, priv->saturation);
+  memcpy (a, tmp, sizeof (tmp));
+}
 
-  if (clutter_gst_video_sink_needs_color_balance_shader (sink))
+static void
+color_matrix_get_Kr_Kb (GstVideoColorMatrix matrix,
+                        gdouble *Kr,
+                        gdouble *Kb)
+{
+  switch (matrix)
     {
-      int i;
-      const guint8 *tables[3] = { priv->tabley, priv->tableu, priv->tablev };
-      const gint tables_sizes[3][2] = { { 256, 1 },
-                                        { 256, 256 },
-                                        { 256, 256 } };
-      SnippetCacheEntry *entry = get_layer_cache_entry (sink, &snippet_cache);
-
-      GST_INFO_OBJECT (sink, "attaching shader color correction");
+    case GST_VIDEO_COLOR_MATRIX_BT601:
+      *Kr = 0.299;
+      *Kb = 0.114;
+      break;
+    case GST_VIDEO_COLOR_MATRIX_FCC:
+      *Kr = 0.30;
+      *Kb = 0.11;
+      break;
+    case GST_VIDEO_COLOR_MATRIX_SMPTE240M:
+      *Kr = 0.212;
+      *Kb = 0.087;
+      break;
+#if GST_CHECK_VERSION (1, 6, 0)
+    case GST_VIDEO_COLOR_MATRIX_BT2020:
+      *Kr = 0.2627;
+      *Kb = 0.0593;
+      break;
+#endif
+    case GST_VIDEO_COLOR_MATRIX_BT709:
+    default:
+      *Kr = 0.2126;
+      *Kb = 0.0722;
+      break;
+    }
+}
 
-      if (entry == NULL)
-        {
-          gchar *source = g_strdup_printf (color_balance_shader,
-                                           priv->custom_start,
-                                           priv->custom_start + 1,
-                                           priv->custom_start + 2,
-                                           priv->custom_start,
-                                           priv->custom_start + 1,
-                                           priv->custom_start + 2);
-
-          entry = add_layer_cache_entry (sink, &snippet_cache, source);
-          g_free (source);
-        }
+/* Y in [0, 1], U and V in [-0.5, 0.5] to RGB */
+static void
+color_matrix_yuv_to_rgb (gdouble m[16],
+                         GstVideoColorMatrix matrix)
+{
+  gdouble Kr, Kb, Kg;
 
-      cogl_pipeline_add_snippet (pipeline, entry->vertex_snippet);
-      cogl_pipeline_add_snippet (pipeline, entry->fragment_snippet);
+  color_matrix_get_Kr_Kb (matrix, &Kr, &Kb);
+  Kg = 1.0 - Kr - Kb;
 
-      clutter_gst_video_sink_color_balance_update_tables (sink);
+  {
+    const gdouble yuv_to_rgb[16] = {
+      1.0, 0.0,                          2 * (1 - Kr),                0.0,
+      1.0, -2 * Kb * (1 - Kb) / Kg,      -2 * Kr * (1 - Kr) / Kg,     0.0,
+      1.0, 2 * (1 - Kb),                 0.0,                         0.0,
+      0.0, 0.0,                          0.0,                         1.0
+    };
 
-      for (i = 0; i < 3; i++)
-        {
-          CoglTexture *lut_texture =
-            cogl_texture_2d_new_from_data (priv->ctx,
-                                           tables_sizes[i][0],
-                                           tables_sizes[i][1],
-                                           COGL_PIXEL_FORMAT_A_8,
-                                           tables_sizes[i][0],
-                                           tables[i],
-                                           NULL);
-
-          cogl_pipeline_set_layer_filters (pipeline,
-                                           priv->custom_start + i,
-                                           COGL_PIPELINE_FILTER_LINEAR,
-                                           COGL_PIPELINE_FILTER_LINEAR);
-          cogl_pipeline_set_layer_combine (pipeline,
-                                           priv->custom_start + i,
-                                           "RGBA=REPLACE(PREVIOUS)",
-                                           NULL);
-          cogl_pipeline_set_layer_texture (pipeline,
-                                           priv->custom_start + i,
-                                           lut_texture);
-
-          cogl_object_unref (lut_texture);
-        }
+    memcpy (m, yuv_to_rgb, sizeof (yuv_to_rgb));
+  }
+}
 
-      priv->video_start = priv->custom_start + 3;
-    }
-  else
-    {
-      GST_INFO_OBJECT (sink, "attaching null color correction");
+static void
+color_matrix_rgb_to_yuv (gdouble m[16],
+                         GstVideoColorMatrix matrix)
+{
+  gdouble Kr, Kb, Kg;
 
-      if (G_UNLIKELY (no_color_balance_snippet_vert == NULL))
-        {
-          no_color_balance_snippet_vert =
-            cogl_snippet_new (COGL_SNIPPET_HOOK_VERTEX_GLOBALS,
-                              no_color_balance_shader,
-                              NULL);
-          no_color_balance_snippet_frag =
-            cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT_GLOBALS,
-                              no_color_balance_shader,
-                              NULL);
-        }
+  color_matrix_get_Kr_Kb (matrix, &Kr, &Kb);
+  Kg = 1.0 - Kr - Kb;
 
-      cogl_pipeline_add_snippet (pipeline, no_color_balance_snippet_vert);
-      cogl_pipeline_add_snippet (pipeline, no_color_balance_snippet_frag);
+  {
+    const gdouble rgb_to_yuv[16] = {
+      Kr,                      Kg,                      Kb,                      0.0,
+      -Kr / (2 * (1 - Kb)),    -Kg / (2 * (1 - Kb)),    0.5,                     0.0,
+      0.5,                     -Kg / (2 * (1 - Kr)),    -Kb / (2 * (1 - Kr)),    0.0,
+      0.0,                     0.0,                     0.0,                     1.0
+    };
 
-      priv->video_start = priv->custom_start;
-    }
+    memcpy (m, rgb_to_yuv, sizeof (rgb_to_yuv));
+  }
 }
 
-/* YUV <-> RGB conversions */
+/* Brightness and contrast on Y, hue and saturation on U and V */
+static void
+color_matrix_balance (ClutterGstVideoSink *sink,
+                      gdouble m[16])
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  gdouble hue_cos = cos (G_PI * priv->hue) * priv->saturation;
+  gdouble hue_sin = sin (G_PI * priv->hue) * priv->saturation;
+  const gdouble balance[16] = {
+    priv->contrast, 0.0,      0.0,     priv->brightness,
+    0.0,            hue_cos,  hue_sin, 0.0,
+    0.0,            -hue_sin, hue_cos, 0.0,
+    0.0,            0.0,      0.0,     1.0
+  };
 
-static const gchar *color_conversions_shaders =
-  "\n"
-  "/* These conversion functions take : */\n"
-  "/*   Y = [0, 1] */\n"
-  "/*   U = [-0.5, 0.5] */\n"
-  "/*   V = [-0.5, 0.5] */\n"
-  "vec3\n"
-  "clutter_gst_yuv_bt601_to_srgb (vec3 yuv)\n"
-  "{\n"
-  "  return mat3 (1.0,    1.0,      1.0,\n"
-  "               0.0,   -0.344136, 1.772,\n"
-  "               1.402, -0.714136, 0.0   ) * yuv;\n"
-  "}\n"
-  "\n"
-  "vec3\n"
-  "clutter_gst_yuv_bt709_to_srgb (vec3 yuv)\n"
-  "{\n"
-  "  return mat3 (1.0,     1.0,      1.0,\n"
-  "               0.0,    -0.187324, 1.8556,\n"
-  "               1.5748, -0.468124, 0.0    ) * yuv;\n"
-  "}\n"
-  "\n"
-  "vec3\n"
-  "clutter_gst_yuv_bt2020_to_srgb (vec3 yuv)\n"
-  "{\n"
-  "  return mat3 (1.0,     1.0,      1.0,\n"
-  "               0.0,     0.571353, 1.8814,\n"
-  "               1.4746,  0.164553, 0.0    ) * yuv;\n"
-  "}\n"
-  "/* Original transformation, still no idea where these values come from... */\n"
-  "vec3\n"
-  "clutter_gst_yuv_originalyuv_to_srgb (vec3 yuv)\n"
-  "{\n"
-  "  return mat3 (1.0,         1.0,      1.0,\n"
-  "               0.0,        -0.390625, 2.015625,\n"
-  "               1.59765625, -0.8125,   0.0      ) * yuv;\n"
-  "}\n"
-  "\n"
-  "vec3\n"
-  "clutter_gst_yuv_srgb_to_bt601 (vec3 rgb)\n"
-  "{\n"
-  "  return mat3 (0.299,  0.5,      -0.168736,\n"
-  "               0.587, -0.418688, -0.331264,\n"
-  "               0.114, -0.081312,  0.5      ) * rgb;\n"
-  "}\n"
-  "\n"
-  "vec3\n"
-  "clutter_gst_yuv_srgb_to_bt709 (vec3 rgb)\n"
-  "{\n"
-  "  return mat3 (0.2126, -0.114626,  0.5,\n"
-  "               0.7152, -0.385428, -0.454153,\n"
-  "               0.0722,  0.5,       0.045847 ) * rgb;\n"
-  "}\n"
-  "\n"
-  "vec3\n"
-  "clutter_gst_yuv_srgb_to_bt2020 (vec3 rgb)\n"
-  "{\n"
-  "  return mat3 (0.2627, -0.139630,  0.503380,\n"
-  "               0.6780, -0.360370, -0.462893,\n"
-  "               0.0593,  0.5,      -0.040486 ) * rgb;\n"
-  "}\n"
-  "\n"
-  "#define clutter_gst_default_yuv_to_srgb(arg) clutter_gst_yuv_%s_to_srgb(arg)\n"
-  "\n";
+  color_matrix_multiply (m, balance);
+}
 
-static const char *
-_gst_video_color_matrix_to_string (GstVideoColorMatrix matrix)
+/* Samples normalized to [0, 1] to Y in [0, 1] and U, V in
+ * [-0.5, 0.5], according to the range and depth of the format */
+static void
+color_matrix_range (ClutterGstVideoSink *sink,
+                    gdouble m[16])
 {
-  switch (matrix)
-    {
-    case GST_VIDEO_COLOR_MATRIX_BT601:
-      return "bt601";
-    case GST_VIDEO_COLOR_MATRIX_BT709:
-      return "bt709";
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  gint offset[GST_VIDEO_MAX_COMPONENTS], scale[GST_VIDEO_MAX_COMPONENTS];
+  gdouble max_value;
+  gdouble range[16] = {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 1.0, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, 0.0, 0.0, 1.0
+  };
+  gint i;
 
-    default:
-      return "bt709";
+  gst_video_color_range_offsets (priv->info.colorimetry.range,
+                                 priv->info.finfo, offset, scale);
+  max_value = (1 << GST_VIDEO_INFO_COMP_DEPTH (&priv->info, 0)) - 1;
+
+  for (i = 0; i < 3; i++)
+    {
+      range[i * 4 + i] = max_value / scale[i];
+      range[i * 4 + 3] = -(gdouble) offset[i] / scale[i];
     }
+
+  /* Gray formats have no chroma to take into account */
+  if (!GST_VIDEO_INFO_IS_YUV (&priv->info))
+    memset (&range[4], 0, 8 * sizeof (gdouble));
+
+  color_matrix_multiply (m, range);
 }
 
 static void
-clutter_gst_video_sink_setup_conversions (ClutterGstVideoSink *sink,
-                                          CoglPipeline *pipeline)
+clutter_gst_video_sink_update_color_matrix (ClutterGstVideoSink *sink,
+                                            CoglPipeline *pipeline)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  GstVideoColorMatrix matrix = priv->info.colorimetry.matrix;
-  static SnippetCache snippet_cache;
-  SnippetCacheEntry *entry = get_global_cache_entry (&snippet_cache, matrix);
+  gdouble m[16];
+  float gl_matrix[16];
+  int location, i, j;
 
-  if (entry == NULL)
+  GST_INFO_OBJECT (sink, "color correction b=%.3f/c=%.3f/h=%.3f/s=%.3f",
+                   priv->brightness, priv->contrast,
+                   priv->hue, priv->saturation);
+
+  if (GST_VIDEO_INFO_IS_RGB (&priv->info))
     {
-      char *source = g_strdup_printf (color_conversions_shaders,
-                                      _gst_video_color_matrix_to_string (matrix));
+      gdouble rgb_to_yuv[16];
 
-      entry = add_global_cache_entry (&snippet_cache, source, matrix);
-      g_free (source);
+      color_matrix_yuv_to_rgb (m, GST_VIDEO_COLOR_MATRIX_BT601);
+      color_matrix_balance (sink, m);
+      color_matrix_rgb_to_yuv (rgb_to_yuv, GST_VIDEO_COLOR_MATRIX_BT601);
+      color_matrix_multiply (m, rgb_to_yuv);
+    }
+  else
+    {
+      color_matrix_yuv_to_rgb (m, priv->info.colorimetry.matrix);
+      color_matrix_balance (sink, m);
+      color_matrix_range (sink, m);
+    }
+
+  /* GL wants column major matrices */
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      gl_matrix[j * 4 + i] = m[i * 4 + j];
+
+  location = cogl_pipeline_get_uniform_location (pipeline,
+                                                 "clutter_gst_color_matrix");
+  cogl_pipeline_set_uniform_matrix (pipeline, location, 4, 1, FALSE,
+                                    gl_matrix);
+}
+
+static void
+clutter_gst_video_sink_setup_color (ClutterGstVideoSink *sink,
+                                    CoglPipeline *pipeline)
+{
+  static CoglSnippet *color_matrix_snippet_vert = NULL,
+    *color_matrix_snippet_frag = NULL;
+
+  if (G_UNLIKELY (color_matrix_snippet_vert == NULL))
+    {
+      color_matrix_snippet_vert =
+        cogl_snippet_new (COGL_SNIPPET_HOOK_VERTEX_GLOBALS,
+                          color_matrix_shader,
+                          NULL);
+      color_matrix_snippet_frag =
+        cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT_GLOBALS,
+                          color_matrix_shader,
+                          NULL);
     }
 
-  cogl_pipeline_add_snippet (pipeline, entry->vertex_snippet);
-  cogl_pipeline_add_snippet (pipeline, entry->fragment_snippet);
+  cogl_pipeline_add_snippet (pipeline, color_matrix_snippet_vert);
+  cogl_pipeline_add_snippet (pipeline, color_matrix_snippet_frag);
+
+  clutter_gst_video_sink_update_color_matrix (sink, pipeline);
 }
 
 /**/
@@ -965,7 +2234,10 @@ clutter_gst_source_prepare (GSource *source,
 
   *timeout = -1;
 
-  return gst_source->buffer != NULL;
+  if (gst_source->redraw_queued)
+    return FALSE;
+
+  return clutter_gst_source_n_queued (gst_source) > 0;
 }
 
 static gboolean
@@ -973,7 +2245,10 @@ clutter_gst_source_check (GSource *source)
 {
   ClutterGstSource *gst_source = (ClutterGstSource *) source;
 
-  return (gst_source->buffer != NULL ||
+  if (gst_source->redraw_queued)
+    return FALSE;
+
+  return (clutter_gst_source_n_queued (gst_source) > 0 ||
           gst_source->sink->priv->balance_dirty);
 }
 
@@ -996,6 +2271,37 @@ dirty_default_pipeline (ClutterGstVideoSink *sink)
       priv->pipeline = NULL;
       priv->had_upload_once = FALSE;
     }
+
+  /* Frames handed out are not modified, a new one will be created
+   * along with the new pipeline */
+  if (priv->clt_frame)
+    {
+      clutter_gst_frame_unref (priv->clt_frame);
+      priv->clt_frame = NULL;
+    }
+}
+
+static void
+clear_gl_ring (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  guint i, j;
+
+  for (i = 0; i < priv->gl_ring_length; i++)
+    {
+      ClutterGstGLTextureSet *set = &priv->gl_ring[i];
+
+      for (j = 0; j < G_N_ELEMENTS (set->textures); j++)
+        if (set->textures[j] != NULL)
+          cogl_object_unref (set->textures[j]);
+
+      gst_buffer_replace (&set->buffer, NULL);
+    }
+
+  g_free (priv->gl_ring);
+  priv->gl_ring = NULL;
+  priv->gl_ring_length = 0;
+  priv->gl_ring_next = 0;
 }
 
 static void
@@ -1006,13 +2312,20 @@ clear_frame_textures (ClutterGstVideoSink *sink)
 
   for (i = 0; i < G_N_ELEMENTS (priv->frame); i++)
     {
-      if (priv->frame[i] == NULL)
-        break;
-      else
+      if (priv->frame[i] != NULL)
         cogl_object_unref (priv->frame[i]);
     }
 
   memset (priv->frame, 0, sizeof (priv->frame));
+  memset (priv->frame_key, 0, sizeof (priv->frame_key));
+
+  clear_gl_ring (sink);
+
+  gst_buffer_replace (&priv->last_buffer, NULL);
+
+  memset (&priv->crop_region, 0, sizeof (priv->crop_region));
+  priv->crop_width = priv->crop_height = 0;
+  priv->orientation = CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY;
 
   priv->frame_dirty = TRUE;
 }
@@ -1065,6 +2378,130 @@ video_texture_new_from_data (CoglContext *ctx,
   return tex;
 }
 
+/* Uploads a plane of the current frame into the texture of the given
+ * layer. The texture used for the previous frame is updated in place
+ * when its format and size match, so that steady state playback
+ * doesn't allocate any texture. A new texture is only allocated when
+ * the plane changes (which normally only happens on caps changes).
+ */
+static gboolean
+video_texture_upload (ClutterGstVideoSink *sink,
+                      guint layer,
+                      int width,
+                      int height,
+                      CoglPixelFormat format,
+                      int rowstride,
+                      const uint8_t *data)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstTextureKey *key = &priv->frame_key[layer];
+
+  if (priv->frame[layer] != NULL &&
+      key->format == format &&
+      key->width == width &&
+      key->height == height)
+    {
+      CoglError *error = NULL;
+
+      if (priv->defer_uploads)
+        {
+          ClutterGstPendingUpload *pending = &priv->pending[priv->n_pending++];
+
+          pending->layer = layer;
+          pending->width = width;
+          pending->height = height;
+          pending->format = format;
+          pending->rowstride = rowstride;
+          pending->data = data;
+
+          return TRUE;
+        }
+
+      if (cogl_texture_set_data (priv->frame[layer], format,
+                                 rowstride, data, 0, &error))
+        {
+          g_atomic_int_inc (&priv->stats.texture_pool_hits);
+          return TRUE;
+        }
+
+      GST_WARNING_OBJECT (sink, "Cannot update Cogl texture : %s",
+                          error->message);
+      cogl_error_free (error);
+    }
+
+  g_atomic_int_inc (&priv->stats.texture_pool_misses);
+
+  GST_DEBUG_OBJECT (sink, "allocating texture for layer %u (%ix%i)",
+                    layer, width, height);
+
+  if (priv->frame[layer] != NULL)
+    cogl_object_unref (priv->frame[layer]);
+
+  priv->frame[layer] = video_texture_new_from_data (priv->ctx,
+                                                    width, height,
+                                                    format,
+                                                    rowstride, data);
+  priv->frame_dirty = TRUE;
+
+  if (priv->frame[layer] == NULL)
+    {
+      memset (key, 0, sizeof (ClutterGstTextureKey));
+      return FALSE;
+    }
+
+  key->format = format;
+  key->width = width;
+  key->height = height;
+
+  return TRUE;
+}
+
+/* Performs the uploads recorded by video_texture_upload() straight
+ * from the pixel buffer backing @mem. Returns FALSE without touching
+ * the textures if the pixel buffer can't be used right now. */
+static gboolean
+video_texture_upload_pending (ClutterGstVideoSink *sink,
+                              GstMemory *mem)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  CoglPixelBuffer *pbo;
+  guint8 *base;
+  gboolean ret = TRUE;
+  guint i;
+
+  pbo = clutter_gst_pixel_buffer_memory_begin_upload (mem, &base);
+  if (pbo == NULL)
+    return FALSE;
+
+  for (i = 0; i < priv->n_pending; i++)
+    {
+      ClutterGstPendingUpload *pending = &priv->pending[i];
+      CoglBitmap *bitmap;
+
+      bitmap = cogl_bitmap_new_from_buffer (COGL_BUFFER (pbo),
+                                            pending->format,
+                                            pending->width,
+                                            pending->height,
+                                            pending->rowstride,
+                                            pending->data - base);
+
+      if (cogl_texture_set_region_from_bitmap (priv->frame[pending->layer],
+                                               0, 0, 0, 0,
+                                               pending->width,
+                                               pending->height,
+                                               bitmap))
+        g_atomic_int_inc (&priv->stats.texture_pool_hits);
+      else
+        ret = FALSE;
+
+      cogl_object_unref (bitmap);
+    }
+
+  clutter_gst_pixel_buffer_memory_end_upload (mem);
+
+  return ret;
+}
+
 static void
 clutter_gst_rgb24_glsl_setup_pipeline (ClutterGstVideoSink *sink,
                                        CoglPipeline *pipeline)
@@ -1082,11 +2519,11 @@ clutter_gst_rgb24_glsl_setup_pipeline (ClutterGstVideoSink *sink,
                          "clutter_gst_sample_video%i (vec2 UV)\n"
                          "{\n"
                          "  vec4 color = texture2D (cogl_sampler%i, UV);\n"
-                         "  vec3 corrected = clutter_gst_get_corrected_color_from_rgb (color.rgb);\n"
+                         "  vec3 corrected = clutter_gst_convert_color (color.rgb);\n"
                          "  return vec4(corrected.rgb, color.a);\n"
                          "}\n",
-                         priv->custom_start,
-                         priv->custom_start);
+                         priv->video_start,
+                         priv->video_start);
 
       entry = add_layer_cache_entry (sink, &snippet_cache, source);
       g_free (source);
@@ -1109,6 +2546,7 @@ clutter_gst_rgb24_upload (ClutterGstVideoSink *sink,
   ClutterGstVideoSinkPrivate *priv = sink->priv;
   CoglPixelFormat format;
   GstVideoFrame frame;
+  gboolean ret;
 
   if (priv->bgr)
     format = COGL_PIXEL_FORMAT_BGR_888;
@@ -1118,18 +2556,16 @@ clutter_gst_rgb24_upload (ClutterGstVideoSink *sink,
   if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
     goto map_fail;
 
-  clear_frame_textures (sink);
-
-  priv->frame[0] = video_texture_new_from_data (priv->ctx,
-                                                GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
-                                                GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
-                                                format,
-                                                GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
-                                                GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
+  ret = video_texture_upload (sink, 0,
+                              GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
+                              GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
+                              format,
+                              GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+                              GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
 
   gst_video_frame_unmap (&frame);
 
-  return TRUE;
+  return ret;
 
  map_fail:
   {
@@ -1147,12 +2583,119 @@ static ClutterGstRenderer rgb24_glsl_renderer =
     GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
                                 "{ RGB, BGR }")),
     1, /* n_layers */
-    clutter_gst_rgb24_glsl_setup_pipeline,
-    clutter_gst_rgb24_upload,
+    clutter_gst_rgb24_glsl_setup_pipeline,
+    clutter_gst_rgb24_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+/* Without GLSL, YUV frames get converted to RGBx on the CPU */
+static gboolean
+clutter_gst_cpu_convert_upload (ClutterGstVideoSink *sink,
+                                GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstVideoFrame frame;
+  gboolean defer_uploads;
+  gint width, height, stride;
+  gboolean ret;
+
+  if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
+    goto map_fail;
+
+  width = GST_VIDEO_FRAME_WIDTH (&frame);
+  height = GST_VIDEO_FRAME_HEIGHT (&frame);
+  stride = width * 4;
+
+  if (priv->cpu_converter == NULL)
+    priv->cpu_converter = clutter_gst_cpu_converter_new ();
+
+  if (priv->cpu_rgbx_size < (gsize) stride * height)
+    {
+      g_free (priv->cpu_rgbx);
+      priv->cpu_rgbx_size = (gsize) stride * height;
+      priv->cpu_rgbx = g_malloc (priv->cpu_rgbx_size);
+    }
+
+  ret = clutter_gst_cpu_converter_convert (priv->cpu_converter, &frame,
+                                           priv->cpu_rgbx, stride);
+
+  gst_video_frame_unmap (&frame);
+
+  if (!ret)
+    return FALSE;
+
+  /* The converted frame doesn't live in the buffer's pixel buffer. The
+   * alpha is opaque, claiming it is premultiplied saves Cogl a pass */
+  defer_uploads = priv->defer_uploads;
+  priv->defer_uploads = FALSE;
+
+  ret = video_texture_upload (sink, 0, width, height,
+                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                              stride, priv->cpu_rgbx);
+
+  priv->defer_uploads = defer_uploads;
+
+  return ret;
+
+ map_fail:
+  {
+    GST_ERROR_OBJECT (sink, "Could not map incoming video frame");
+    return FALSE;
+  }
+}
+
+static ClutterGstRenderer i420_cpu_renderer =
+  {
+    "I420 cpu",
+    CLUTTER_GST_PLANAR,
+    0,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "I420")),
+    1, /* n_layers */
+    clutter_gst_rgb24_setup_pipeline,
+    clutter_gst_cpu_convert_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+static ClutterGstRenderer nv12_cpu_renderer =
+  {
+    "NV12 cpu",
+    CLUTTER_GST_SEMI_PLANAR,
+    0,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "NV12")),
+    1, /* n_layers */
+    clutter_gst_rgb24_setup_pipeline,
+    clutter_gst_cpu_convert_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+static ClutterGstRenderer yuy2_cpu_renderer =
+  {
+    "YUY2 cpu",
+    CLUTTER_GST_YUY2,
+    0,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "YUY2")),
+    1, /* n_layers */
+    clutter_gst_rgb24_setup_pipeline,
+    clutter_gst_cpu_convert_upload,
     clutter_gst_dummy_upload_gl,
     clutter_gst_dummy_shutdown,
   };
 
+/* Pixel buffers are usually mapped uncached, reading every pixel back
+ * from them as the CPU renderers do is many times slower than from
+ * system memory, and the converted frame isn't uploaded from them */
+static gboolean
+clutter_gst_renderer_converts_on_cpu (ClutterGstRenderer *renderer)
+{
+  return renderer->upload == clutter_gst_cpu_convert_upload;
+}
+
 static ClutterGstRenderer rgb24_renderer =
   {
     "RGB 24",
@@ -1184,13 +2727,13 @@ clutter_gst_rgb32_glsl_setup_pipeline (ClutterGstVideoSink *sink,
                          "clutter_gst_sample_video%i (vec2 UV)\n"
                          "{\n"
                          "  vec4 color = texture2D (cogl_sampler%i, UV);\n"
-                         "  vec3 corrected = clutter_gst_get_corrected_color_from_rgb (color.rgb);\n"
+                         "  vec3 corrected = clutter_gst_convert_color (color.rgb);\n"
                          /* Premultiply the color */
                          "  corrected.rgb *= color.a;\n"
                          "  return vec4(corrected.rgb, color.a);\n"
                          "}\n",
-                         priv->custom_start,
-                         priv->custom_start);
+                         priv->video_start,
+                         priv->video_start);
 
       entry = add_layer_cache_entry (sink, &snippet_cache, source);
       g_free (source);
@@ -1226,6 +2769,7 @@ clutter_gst_rgb32_upload (ClutterGstVideoSink *sink,
   ClutterGstVideoSinkPrivate *priv = sink->priv;
   CoglPixelFormat format;
   GstVideoFrame frame;
+  gboolean ret;
 
   if (priv->bgr)
     format = COGL_PIXEL_FORMAT_BGRA_8888;
@@ -1235,18 +2779,16 @@ clutter_gst_rgb32_upload (ClutterGstVideoSink *sink,
   if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
     goto map_fail;
 
-  clear_frame_textures (sink);
-
-  priv->frame[0] = video_texture_new_from_data (priv->ctx,
-                                                GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
-                                                GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
-                                                format,
-                                                GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
-                                                GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
+  ret = video_texture_upload (sink, 0,
+                              GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
+                              GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
+                              format,
+                              GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+                              GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
 
   gst_video_frame_unmap (&frame);
 
-  return TRUE;
+  return ret;
 
  map_fail:
   {
@@ -1255,73 +2797,124 @@ clutter_gst_rgb32_upload (ClutterGstVideoSink *sink,
   }
 }
 
-static CoglUserDataKey gl_upload_texture_private_key;
-#define MAX_ALLOCATED_GL_TEXTURES (1)
+static CoglTextureComponents
+gl_texture_type_to_components (GstVideoGLTextureType type)
+{
+  switch (type)
+    {
+    case GST_VIDEO_GL_TEXTURE_TYPE_RGBA:
+      return COGL_TEXTURE_COMPONENTS_RGBA;
+    case GST_VIDEO_GL_TEXTURE_TYPE_RG:
+      return COGL_TEXTURE_COMPONENTS_RG;
+    default:
+      return COGL_TEXTURE_COMPONENTS_RGB;
+    }
+}
 
+/* Uploads the frame into the next set of textures of the ring, which
+ * then become the textures of the current frame */
 static gboolean
-clutter_gst_rgb32_upload_gl (ClutterGstVideoSink *sink,
-                             GstBuffer *buffer)
+clutter_gst_gl_ring_upload (ClutterGstVideoSink *sink,
+                            GstBuffer *buffer,
+                            GstVideoGLTextureUploadMeta *upload_meta)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  GstVideoGLTextureUploadMeta *upload_meta;
-  gint i;
-  guint gl_handle[1];
-
-  //clear_frame_textures (sink);
+  const GstVideoFormatInfo *finfo = priv->info.finfo;
+  ClutterGstGLTextureSet *set;
+  guint gl_handle[4] = { 0, };
+  guint i, c;
 
-  upload_meta = gst_buffer_get_video_gl_texture_upload_meta (buffer);
-  if (!upload_meta) {
-    GST_WARNING ("Buffer does not support GLTextureUploadMeta API");
+  if (upload_meta->n_textures > G_N_ELEMENTS (set->textures))
     return FALSE;
-  }
 
-  if (upload_meta->n_textures != priv->renderer->n_layers ||
-      upload_meta->texture_type[0] != GST_VIDEO_GL_TEXTURE_TYPE_RGBA) {
-    GST_WARNING ("clutter-gst-video-sink only supports gl upload in a single RGBA texture");
-    return FALSE;
-  }
+  if (priv->gl_ring == NULL)
+    {
+      priv->gl_ring_length = priv->gl_texture_ring_size;
+      priv->gl_ring = g_new0 (ClutterGstGLTextureSet, priv->gl_ring_length);
+      priv->gl_ring_next = 0;
+    }
 
-  if (priv->frame[0] == NULL)
+  /* With a ring of a single set this is the set being displayed */
+  set = &priv->gl_ring[priv->gl_ring_next];
+  priv->gl_ring_next = (priv->gl_ring_next + 1) % priv->gl_ring_length;
+
+  for (i = 0; i < upload_meta->n_textures; i++)
     {
-      for (i = 0; i < MAX_ALLOCATED_GL_TEXTURES; i++) {
-        priv->frame[i] = COGL_TEXTURE (cogl_texture_2d_new_with_size (priv->ctx,
-                                                                      priv->info.width,
-                                                                      priv->info.height));
-        cogl_texture_set_components (priv->frame[i], COGL_TEXTURE_COMPONENTS_RGBA);
+      CoglTexture *tex = set->textures[i];
+
+      if (tex == NULL)
+        {
+          /* The size of a plane is the size of its components */
+          for (c = 0; c < GST_VIDEO_INFO_N_COMPONENTS (&priv->info); c++)
+            if (GST_VIDEO_FORMAT_INFO_PLANE (finfo, c) == i)
+              break;
+
+          tex = COGL_TEXTURE (cogl_texture_2d_new_with_size (priv->ctx,
+                                                             GST_VIDEO_INFO_COMP_WIDTH (&priv->info, c),
+                                                             GST_VIDEO_INFO_COMP_HEIGHT (&priv->info, c)));
+          cogl_texture_set_components (tex,
+                                       gl_texture_type_to_components (upload_meta->texture_type[i]));
+
+          if (!cogl_texture_allocate (tex, NULL))
+            {
+              GST_WARNING_OBJECT (sink, "Couldn't allocate cogl texture");
+              cogl_object_unref (tex);
+              return FALSE;
+            }
+
+          set->textures[i] = tex;
+        }
 
-        if (!cogl_texture_allocate (priv->frame[i], NULL)) {
-          GST_WARNING ("Couldn't allocate cogl texture");
+      if (!cogl_texture_get_gl_texture (tex, &gl_handle[i], NULL))
+        {
+          GST_WARNING_OBJECT (sink, "Couldn't get gl texture");
           return FALSE;
         }
-      }
     }
-  else
+
+  /* Dropping the buffer the set was previously uploaded from, the
+   * frames uploaded since then have replaced it on screen */
+  gst_buffer_replace (&set->buffer, buffer);
+
+  if (!gst_video_gl_texture_upload_meta_upload (upload_meta, gl_handle))
+    {
+      GST_WARNING_OBJECT (sink, "GL texture upload failed");
+      return FALSE;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (priv->frame); i++)
     {
-      CoglTexture *tmp;
+      CoglTexture *tex = i < upload_meta->n_textures ? set->textures[i] : NULL;
 
-      tmp = priv->frame[0];
-      for (i = 0; i < MAX_ALLOCATED_GL_TEXTURES - 1; i++)
-        priv->frame[i] = priv->frame[i + 1];
-      priv->frame[MAX_ALLOCATED_GL_TEXTURES - 1] = tmp;
+      if (priv->frame[i] != NULL)
+        cogl_object_unref (priv->frame[i]);
+      priv->frame[i] = tex ? cogl_object_ref (tex) : NULL;
     }
 
-  cogl_object_set_user_data (COGL_OBJECT (priv->frame[0]),
-                             &gl_upload_texture_private_key,
-                             gst_buffer_ref (buffer),
-                             (CoglUserDataDestroyCallback) gst_buffer_unref);
+  /* The textures are not ours to update from system memory */
+  memset (priv->frame_key, 0, sizeof (priv->frame_key));
+  priv->frame_dirty = TRUE;
 
+  return TRUE;
+}
 
-  if (!cogl_texture_get_gl_texture (priv->frame[0], &gl_handle[0], NULL)) {
-    GST_WARNING ("Couldn't get gl texture");
-    return FALSE;
-  }
+static gboolean
+clutter_gst_rgb32_upload_gl (ClutterGstVideoSink *sink,
+                             GstBuffer *buffer)
+{
+  GstVideoGLTextureUploadMeta *upload_meta;
 
-  if (!gst_video_gl_texture_upload_meta_upload (upload_meta, gl_handle)) {
-    GST_WARNING ("GL texture upload failed");
-    return FALSE;
-  }
+  upload_meta = gst_buffer_get_video_gl_texture_upload_meta (buffer);
 
-  return TRUE;
+  if (upload_meta->n_textures != 1 ||
+      upload_meta->texture_type[0] != GST_VIDEO_GL_TEXTURE_TYPE_RGBA)
+    {
+      GST_WARNING_OBJECT (sink, "clutter-gst-video-sink only supports gl "
+                          "upload of RGBA in a single texture");
+      return FALSE;
+    }
+
+  return clutter_gst_gl_ring_upload (sink, buffer, upload_meta);
 }
 
 static ClutterGstRenderer rgb32_glsl_renderer =
@@ -1358,94 +2951,64 @@ static ClutterGstRenderer rgb32_renderer =
     clutter_gst_dummy_shutdown,
   };
 
-static gboolean
-clutter_gst_yv12_upload (ClutterGstVideoSink *sink,
-                         GstBuffer *buffer)
+static void
+clutter_gst_ayuv_glsl_setup_pipeline (ClutterGstVideoSink *sink,
+                                      CoglPipeline *pipeline)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  CoglPixelFormat format = COGL_PIXEL_FORMAT_A_8;
-  GstVideoFrame frame;
+  static SnippetCache snippet_cache;
+  SnippetCacheEntry *entry;
 
-  if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
-    goto map_fail;
+  entry = get_layer_cache_entry (sink, &snippet_cache);
 
-  clear_frame_textures (sink);
-
-  priv->frame[0] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
-                                 GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
-                                 format,
-                                 GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
-                                 GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
-
-  priv->frame[2] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_FRAME_COMP_WIDTH (&frame, 1),
-                                 GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 1),
-                                 format,
-                                 GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 1),
-                                 GST_VIDEO_FRAME_PLANE_DATA (&frame, 1));
-
-  priv->frame[1] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_FRAME_COMP_WIDTH (&frame, 2),
-                                 GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 2),
-                                 format,
-                                 GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 2),
-                                 GST_VIDEO_FRAME_PLANE_DATA (&frame, 2));
+  if (entry == NULL)
+    {
+      char *source;
 
-  gst_video_frame_unmap (&frame);
+      source
+        = g_strdup_printf ("vec4\n"
+                           "clutter_gst_sample_video%i (vec2 UV)\n"
+                           "{\n"
+                           "  vec4 color = texture2D (cogl_sampler%i, UV);\n"
+                           "  float alpha = color.r;\n"
+                           "  color.rgb = clutter_gst_convert_color (color.gba);\n"
+                           "  color.a = alpha;\n"
+                           /* Premultiply the color */
+                           "  color.rgb *= color.a;\n"
+                           "  return color;\n"
+                           "}\n",
+                           priv->video_start,
+                           priv->video_start);
 
-  return TRUE;
+      entry = add_layer_cache_entry (sink, &snippet_cache, source);
+      g_free (source);
+    }
 
- map_fail:
-  {
-    GST_ERROR_OBJECT (sink, "Could not map incoming video frame");
-    return FALSE;
-  }
+  setup_pipeline_from_cache_entry (sink, pipeline, entry, 1);
 }
 
 static gboolean
-clutter_gst_i420_upload (ClutterGstVideoSink *sink,
+clutter_gst_ayuv_upload (ClutterGstVideoSink *sink,
                          GstBuffer *buffer)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  CoglPixelFormat format = COGL_PIXEL_FORMAT_A_8;
+  CoglPixelFormat format = COGL_PIXEL_FORMAT_RGBA_8888;
   GstVideoFrame frame;
+  gboolean ret;
 
   if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
     goto map_fail;
 
-  clear_frame_textures (sink);
-
-  priv->frame[0] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
-                                 GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
-                                 format,
-                                 GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
-                                 GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
-
-  priv->frame[1] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_FRAME_COMP_WIDTH (&frame, 1),
-                                 GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 1),
-                                 format,
-                                 GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 1),
-                                 GST_VIDEO_FRAME_PLANE_DATA (&frame, 1));
-
-  priv->frame[2] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_FRAME_COMP_WIDTH (&frame, 2),
-                                 GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 2),
-                                 format,
-                                 GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 2),
-                                 GST_VIDEO_FRAME_PLANE_DATA (&frame, 2));
+  ret = video_texture_upload (sink, 0,
+                              GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
+                              GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
+                              format,
+                              GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+                              GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
 
   gst_video_frame_unmap (&frame);
 
-  return TRUE;
+  return ret;
 
  map_fail:
   {
@@ -1454,135 +3017,301 @@ clutter_gst_i420_upload (ClutterGstVideoSink *sink,
   }
 }
 
-static void
-clutter_gst_yv12_glsl_setup_pipeline (ClutterGstVideoSink *sink,
-                                      CoglPipeline *pipeline)
+static ClutterGstRenderer ayuv_glsl_renderer =
+  {
+    "AYUV glsl",
+    CLUTTER_GST_AYUV,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL,
+    GST_STATIC_CAPS (MAKE_CAPS(GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                               "AYUV")),
+    1, /* n_layers */
+    clutter_gst_ayuv_glsl_setup_pipeline,
+    clutter_gst_ayuv_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+/* Planar and semi planar YUV formats are described by a table rather
+ * than with a pair of functions each. Each plane of the frame is
+ * uploaded into its own layer and the shader fetches the Y, U and V
+ * components from the layers and components listed here. */
+typedef struct
 {
-  ClutterGstVideoSinkPrivate *priv = sink->priv;
-  static SnippetCache snippet_cache;
-  SnippetCacheEntry *entry;
+  /* Component giving the dimensions of the plane */
+  int component;
+  CoglPixelFormat pixel_format;
+} ClutterGstPlaneDesc;
 
-  entry = get_layer_cache_entry (sink, &snippet_cache);
+typedef struct
+{
+  /* Layer holding the component, -1 if the format doesn't have it */
+  int layer;
+  const char *swizzle;
+} ClutterGstComponentDesc;
 
-  if (entry == NULL)
-    {
-      char *source;
+typedef struct
+{
+  GstVideoFormat format;
+  int n_planes;
+  ClutterGstPlaneDesc planes[3];
+  /* Y, U and V */
+  ClutterGstComponentDesc components[3];
+  /* Components stored in 16 bits words, with their bits in the high
+   * bits of the word if msb_aligned */
+  gboolean high_depth;
+  gboolean msb_aligned;
+  SnippetCache snippet_cache;
+  SnippetCache gl_snippet_cache;
+} ClutterGstPlanarFormat;
+
+#define PLANES_3(f) \
+  { { 0, f }, { 1, f }, { 2, f } }
+#define PLANES_2(f0, f1) \
+  { { 0, f0 }, { 1, f1 } }
+
+static ClutterGstPlanarFormat planar_formats[] =
+  {
+    { GST_VIDEO_FORMAT_I420, 3, PLANES_3 (COGL_PIXEL_FORMAT_A_8),
+      { { 0, "a" }, { 1, "a" }, { 2, "a" } } },
+    /* V comes before U */
+    { GST_VIDEO_FORMAT_YV12, 3,
+      { { 0, COGL_PIXEL_FORMAT_A_8 },
+        { 2, COGL_PIXEL_FORMAT_A_8 },
+        { 1, COGL_PIXEL_FORMAT_A_8 } },
+      { { 0, "a" }, { 2, "a" }, { 1, "a" } } },
+    { GST_VIDEO_FORMAT_Y42B, 3, PLANES_3 (COGL_PIXEL_FORMAT_A_8),
+      { { 0, "a" }, { 1, "a" }, { 2, "a" } } },
+    { GST_VIDEO_FORMAT_Y444, 3, PLANES_3 (COGL_PIXEL_FORMAT_A_8),
+      { { 0, "a" }, { 1, "a" }, { 2, "a" } } },
+    { GST_VIDEO_FORMAT_GRAY8, 1, { { 0, COGL_PIXEL_FORMAT_A_8 } },
+      { { 0, "a" }, { -1, NULL }, { -1, NULL } } },
+
+    { GST_VIDEO_FORMAT_NV12, 2,
+      PLANES_2 (COGL_PIXEL_FORMAT_A_8, COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "a" }, { 1, "r" }, { 1, "g" } } },
+    { GST_VIDEO_FORMAT_NV21, 2,
+      PLANES_2 (COGL_PIXEL_FORMAT_A_8, COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "a" }, { 1, "g" }, { 1, "r" } } },
+    { GST_VIDEO_FORMAT_NV16, 2,
+      PLANES_2 (COGL_PIXEL_FORMAT_A_8, COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "a" }, { 1, "r" }, { 1, "g" } } },
+    { GST_VIDEO_FORMAT_NV61, 2,
+      PLANES_2 (COGL_PIXEL_FORMAT_A_8, COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "a" }, { 1, "g" }, { 1, "r" } } },
+
+    /* Cogl has no texture format with 16 bits components so the 16
+     * bits words are uploaded as they are, the low and high bytes
+     * landing in 2 components of 8 bits textures */
+    { GST_VIDEO_FORMAT_I420_10LE, 3, PLANES_3 (COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "rg" }, { 1, "rg" }, { 2, "rg" } }, TRUE, FALSE },
+    { GST_VIDEO_FORMAT_I422_10LE, 3, PLANES_3 (COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "rg" }, { 1, "rg" }, { 2, "rg" } }, TRUE, FALSE },
+    { GST_VIDEO_FORMAT_Y444_10LE, 3, PLANES_3 (COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "rg" }, { 1, "rg" }, { 2, "rg" } }, TRUE, FALSE },
+#if GST_CHECK_VERSION (1, 12, 0)
+    { GST_VIDEO_FORMAT_I420_12LE, 3, PLANES_3 (COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "rg" }, { 1, "rg" }, { 2, "rg" } }, TRUE, FALSE },
+    { GST_VIDEO_FORMAT_I422_12LE, 3, PLANES_3 (COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "rg" }, { 1, "rg" }, { 2, "rg" } }, TRUE, FALSE },
+    { GST_VIDEO_FORMAT_Y444_12LE, 3, PLANES_3 (COGL_PIXEL_FORMAT_RG_88),
+      { { 0, "rg" }, { 1, "rg" }, { 2, "rg" } }, TRUE, FALSE },
+#endif
+#if GST_CHECK_VERSION (1, 10, 0)
+    /* Each chroma texel holds the 2 bytes of U followed by the 2 bytes
+     * of V, claiming it is premultiplied keeps Cogl from touching
+     * them */
+    { GST_VIDEO_FORMAT_P010_10LE, 2,
+      PLANES_2 (COGL_PIXEL_FORMAT_RG_88, COGL_PIXEL_FORMAT_RGBA_8888_PRE),
+      { { 0, "rg" }, { 1, "rg" }, { 1, "ba" } }, TRUE, TRUE },
+#endif
+  };
 
-      source =
-        g_strdup_printf ("vec4\n"
-                         "clutter_gst_sample_video%i (vec2 UV)\n"
-                         "{\n"
-                         "  float y = 1.1640625 * (texture2D (cogl_sampler%i, UV).a - 0.0625);\n"
-                         "  float u = texture2D (cogl_sampler%i, UV).a - 0.5;\n"
-                         "  float v = texture2D (cogl_sampler%i, UV).a - 0.5;\n"
-                         "  vec3 corrected = clutter_gst_get_corrected_color_from_yuv (vec3 (y, u, v));\n"
-                         "  vec4 color;\n"
-                         "  color.rgb = clutter_gst_default_yuv_to_srgb (corrected);\n"
-                         "  color.a = 1.0;\n"
-                         "  return color;\n"
-                         "}\n",
-                         priv->video_start,
-                         priv->video_start,
-                         priv->video_start + 1,
-                         priv->video_start + 2);
+#undef PLANES_3
+#undef PLANES_2
 
-      entry = add_layer_cache_entry (sink, &snippet_cache, source);
-      g_free (source);
-    }
+static ClutterGstPlanarFormat *
+clutter_gst_find_planar_format (GstVideoFormat format)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (planar_formats); i++)
+    if (planar_formats[i].format == format)
+      return &planar_formats[i];
 
-  setup_pipeline_from_cache_entry (sink, pipeline, entry, 3);
+  return NULL;
 }
 
-static ClutterGstRenderer yv12_glsl_renderer =
-  {
-    "YV12 glsl",
-    CLUTTER_GST_YV12,
-    CLUTTER_GST_RENDERER_NEEDS_GLSL,
-    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
-                                "YV12")),
-    3, /* n_layers */
-    clutter_gst_yv12_glsl_setup_pipeline,
-    clutter_gst_yv12_upload,
-    clutter_gst_dummy_upload_gl,
-    clutter_gst_dummy_shutdown,
-  };
+/* Scale turning the (low + high * 256) sum of the normalized bytes of
+ * a 16 bits sample into a normalized value */
+static float
+clutter_gst_high_depth_scale (ClutterGstVideoSink *sink,
+                              gboolean msb_aligned)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  guint depth = GST_VIDEO_INFO_COMP_DEPTH (&priv->info, 0);
+  float max_value = (1 << depth) - 1;
 
-static ClutterGstRenderer i420_glsl_renderer =
-  {
-    "I420 glsl",
-    CLUTTER_GST_I420,
-    CLUTTER_GST_RENDERER_NEEDS_GLSL,
-    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
-                                "I420")),
-    3, /* n_layers */
-    clutter_gst_yv12_glsl_setup_pipeline,
-    clutter_gst_i420_upload,
-    clutter_gst_dummy_upload_gl,
-    clutter_gst_dummy_shutdown,
-  };
+  if (msb_aligned)
+    max_value *= 1 << (16 - depth);
+
+  return 255.0f / max_value;
+}
+
+/* Textures filled through the GL upload meta hold the single
+ * component planes in their red component rather than the alpha one */
+static char *
+clutter_gst_planar_build_source (ClutterGstVideoSink *sink,
+                                 const ClutterGstPlanarFormat *desc,
+                                 gboolean gl_textures)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  static const char *const names[] = { "y", "u", "v" };
+  GString *source = g_string_new (NULL);
+  int i;
+
+  if (desc->high_depth)
+    g_string_append_printf (source,
+                            "uniform float clutter_gst_sample_scale%i;\n"
+                            "\n"
+                            "float\n"
+                            "clutter_gst_sample_16_%i (vec2 bytes)\n"
+                            "{\n"
+                            "  return (bytes.x + bytes.y * 256.0) *\n"
+                            "    clutter_gst_sample_scale%i;\n"
+                            "}\n"
+                            "\n",
+                            priv->video_start,
+                            priv->video_start,
+                            priv->video_start);
+
+  g_string_append_printf (source,
+                          "vec4\n"
+                          "clutter_gst_sample_video%i (vec2 UV)\n"
+                          "{\n",
+                          priv->video_start);
+
+  for (i = 0; i < 3; i++)
+    {
+      const ClutterGstComponentDesc *component = &desc->components[i];
+      const char *swizzle = component->swizzle;
+
+      if (gl_textures && component->layer >= 0 &&
+          desc->planes[component->layer].pixel_format == COGL_PIXEL_FORMAT_A_8)
+        swizzle = "r";
+
+      if (component->layer < 0)
+        g_string_append_printf (source, "  float %s = 0.5;\n", names[i]);
+      else if (desc->high_depth)
+        g_string_append_printf (source,
+                                "  float %s = clutter_gst_sample_16_%i "
+                                "(texture2D (cogl_sampler%i, UV).%s);\n",
+                                names[i],
+                                priv->video_start,
+                                priv->video_start + component->layer,
+                                swizzle);
+      else
+        g_string_append_printf (source,
+                                "  float %s = "
+                                "texture2D (cogl_sampler%i, UV).%s;\n",
+                                names[i],
+                                priv->video_start + component->layer,
+                                swizzle);
+    }
+
+  g_string_append (source,
+                   "  vec4 color;\n"
+                   "  color.rgb = clutter_gst_convert_color (vec3 (y, u, v));\n"
+                   "  color.a = 1.0;\n"
+                   "  return color;\n"
+                   "}\n");
+
+  return g_string_free (source, FALSE);
+}
 
 static void
-clutter_gst_ayuv_glsl_setup_pipeline (ClutterGstVideoSink *sink,
-                                      CoglPipeline *pipeline)
+clutter_gst_planar_glsl_setup_pipeline (ClutterGstVideoSink *sink,
+                                        CoglPipeline *pipeline)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  static SnippetCache snippet_cache;
+  ClutterGstPlanarFormat *desc;
+  SnippetCache *snippet_cache;
   SnippetCacheEntry *entry;
 
-  entry = get_layer_cache_entry (sink, &snippet_cache);
+  desc = clutter_gst_find_planar_format (GST_VIDEO_INFO_FORMAT (&priv->info));
+  g_return_if_fail (desc != NULL);
+
+  snippet_cache = priv->gl_upload ?
+    &desc->gl_snippet_cache : &desc->snippet_cache;
+  entry = get_layer_cache_entry (sink, snippet_cache);
 
   if (entry == NULL)
     {
-      char *source;
-
-      source
-        = g_strdup_printf ("vec4\n"
-                           "clutter_gst_sample_video%i (vec2 UV)\n"
-                           "{\n"
-                           "  vec4 color = texture2D (cogl_sampler%i, UV);\n"
-                           "  float y = 1.1640625 * (color.g - 0.0625);\n"
-                           "  float u = color.b - 0.5;\n"
-                           "  float v = color.a - 0.5;\n"
-                           "  vec3 corrected = clutter_gst_get_corrected_color_from_yuv (vec3 (y, u, v));\n"
-                           "  color.a = color.r;\n"
-                           "  color.rgb = clutter_gst_default_yuv_to_srgb (corrected);\n"
-                           /* Premultiply the color */
-                           "  color.rgb *= color.a;\n"
-                           "  return color;\n"
-                           "}\n",
-                           priv->video_start,
-                           priv->video_start);
+      char *source = clutter_gst_planar_build_source (sink, desc,
+                                                      priv->gl_upload);
 
-      entry = add_layer_cache_entry (sink, &snippet_cache, source);
+      entry = add_layer_cache_entry (sink, snippet_cache, source);
       g_free (source);
     }
 
-  setup_pipeline_from_cache_entry (sink, pipeline, entry, 1);
+  setup_pipeline_from_cache_entry (sink, pipeline, entry, desc->n_planes);
+
+  if (desc->high_depth)
+    {
+      char *uniform_name;
+      int location;
+      int i;
+
+      /* Interpolating the low and high bytes separately would give
+       * garbage */
+      for (i = 0; i < desc->n_planes; i++)
+        cogl_pipeline_set_layer_filters (pipeline,
+                                         priv->video_start + i,
+                                         COGL_PIPELINE_FILTER_NEAREST,
+                                         COGL_PIPELINE_FILTER_NEAREST);
+
+      uniform_name = g_strdup_printf ("clutter_gst_sample_scale%i",
+                                      priv->video_start);
+      location = cogl_pipeline_get_uniform_location (pipeline, uniform_name);
+      cogl_pipeline_set_uniform_1f (pipeline, location,
+                                    clutter_gst_high_depth_scale (sink,
+                                                                  desc->msb_aligned));
+      g_free (uniform_name);
+    }
 }
 
 static gboolean
-clutter_gst_ayuv_upload (ClutterGstVideoSink *sink,
-                         GstBuffer *buffer)
+clutter_gst_planar_upload (ClutterGstVideoSink *sink,
+                           GstBuffer *buffer)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  CoglPixelFormat format = COGL_PIXEL_FORMAT_RGBA_8888;
+  const ClutterGstPlanarFormat *desc;
   GstVideoFrame frame;
+  gboolean ret = TRUE;
+  int i;
+
+  desc = clutter_gst_find_planar_format (GST_VIDEO_INFO_FORMAT (&priv->info));
+  g_return_val_if_fail (desc != NULL, FALSE);
 
   if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
     goto map_fail;
 
-  clear_frame_textures (sink);
-
-  priv->frame[0] = video_texture_new_from_data (priv->ctx,
-                                                GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0),
-                                                GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0),
-                                                format,
-                                                GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
-                                                GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
+  for (i = 0; i < desc->n_planes; i++)
+    {
+      const ClutterGstPlaneDesc *plane = &desc->planes[i];
+
+      ret &= video_texture_upload (sink, i,
+                                   GST_VIDEO_FRAME_COMP_WIDTH (&frame,
+                                                               plane->component),
+                                   GST_VIDEO_FRAME_COMP_HEIGHT (&frame,
+                                                                plane->component),
+                                   plane->pixel_format,
+                                   GST_VIDEO_FRAME_PLANE_STRIDE (&frame, i),
+                                   GST_VIDEO_FRAME_PLANE_DATA (&frame, i));
+    }
 
   gst_video_frame_unmap (&frame);
 
-  return TRUE;
+  return ret;
 
  map_fail:
   {
@@ -1591,93 +3320,236 @@ clutter_gst_ayuv_upload (ClutterGstVideoSink *sink,
   }
 }
 
-static ClutterGstRenderer ayuv_glsl_renderer =
+static gboolean
+clutter_gst_planar_upload_gl (ClutterGstVideoSink *sink,
+                              GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  const ClutterGstPlanarFormat *desc;
+  GstVideoGLTextureUploadMeta *upload_meta;
+  int i;
+
+  desc = clutter_gst_find_planar_format (GST_VIDEO_INFO_FORMAT (&priv->info));
+  g_return_val_if_fail (desc != NULL, FALSE);
+
+  upload_meta = gst_buffer_get_video_gl_texture_upload_meta (buffer);
+
+  if ((int) upload_meta->n_textures != desc->n_planes)
+    goto unsupported;
+
+  /* The planes are sampled from the red (and green) components */
+  for (i = 0; i < desc->n_planes; i++)
+    {
+      GstVideoGLTextureType type = upload_meta->texture_type[i];
+
+      if (desc->planes[i].pixel_format == COGL_PIXEL_FORMAT_RG_88 ?
+          type != GST_VIDEO_GL_TEXTURE_TYPE_RG :
+          (type != GST_VIDEO_GL_TEXTURE_TYPE_R &&
+           type != GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE))
+        goto unsupported;
+    }
+
+  return clutter_gst_gl_ring_upload (sink, buffer, upload_meta);
+
+ unsupported:
+  {
+    GST_WARNING_OBJECT (sink, "Unsupported texture layout for GL upload");
+    return FALSE;
+  }
+}
+
+static ClutterGstRenderer planar_glsl_renderer =
+  {
+    "Planar YUV glsl",
+    CLUTTER_GST_PLANAR,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL,
+    GST_STATIC_CAPS (
+#ifdef HAVE_GL_TEXTURE_UPLOAD
+                     MAKE_CAPS (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META,
+                                "I420")
+                     ";"
+#endif
+                     MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "{ I420, YV12, Y42B, Y444, GRAY8 }")),
+    3, /* n_layers */
+    clutter_gst_planar_glsl_setup_pipeline,
+    clutter_gst_planar_upload,
+    clutter_gst_planar_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+static ClutterGstRenderer semi_planar_glsl_renderer =
+  {
+    "Semi planar YUV glsl",
+    CLUTTER_GST_SEMI_PLANAR,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL | CLUTTER_GST_RENDERER_NEEDS_TEXTURE_RG,
+    GST_STATIC_CAPS (
+#ifdef HAVE_GL_TEXTURE_UPLOAD
+                     MAKE_CAPS (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META,
+                                "NV12")
+                     ";"
+#endif
+                     MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "{ NV12, NV21, NV16, NV61 }")),
+    2, /* n_layers */
+    clutter_gst_planar_glsl_setup_pipeline,
+    clutter_gst_planar_upload,
+    clutter_gst_planar_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+static ClutterGstRenderer planar_16_glsl_renderer =
   {
-    "AYUV glsl",
-    CLUTTER_GST_AYUV,
-    CLUTTER_GST_RENDERER_NEEDS_GLSL,
-    GST_STATIC_CAPS (MAKE_CAPS(GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
-                               "AYUV")),
-    1, /* n_layers */
-    clutter_gst_ayuv_glsl_setup_pipeline,
-    clutter_gst_ayuv_upload,
+    "16 bits planar YUV glsl",
+    CLUTTER_GST_PLANAR_16,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL | CLUTTER_GST_RENDERER_NEEDS_TEXTURE_RG,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                HIGH_DEPTH_PLANAR_CAPS)),
+    3, /* n_layers */
+    clutter_gst_planar_glsl_setup_pipeline,
+    clutter_gst_planar_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+#if GST_CHECK_VERSION (1, 10, 0)
+static ClutterGstRenderer p010_glsl_renderer =
+  {
+    "P010 glsl",
+    CLUTTER_GST_P010,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL | CLUTTER_GST_RENDERER_NEEDS_TEXTURE_RG,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "P010_10LE")),
+    2, /* n_layers */
+    clutter_gst_planar_glsl_setup_pipeline,
+    clutter_gst_planar_upload,
     clutter_gst_dummy_upload_gl,
     clutter_gst_dummy_shutdown,
   };
+#endif
 
+/* Packed 4:2:2 formats hold 2 pixels in 4 bytes, sharing the chroma.
+ * They are uploaded as an RGBA texture of half the width of the video
+ * and unpacked in the shader, @luma and @chroma give the components of
+ * the texels holding the 2 luma values and the U and V values. */
 static void
-clutter_gst_nv12_glsl_setup_pipeline (ClutterGstVideoSink *sink,
-                                      CoglPipeline *pipeline)
+clutter_gst_packed_422_glsl_setup_pipeline (ClutterGstVideoSink *sink,
+                                            CoglPipeline *pipeline,
+                                            SnippetCache *snippet_cache,
+                                            const char *luma,
+                                            const char *chroma)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
-  static SnippetCache snippet_cache;
   SnippetCacheEntry *entry;
+  char *uniform_name;
+  int location;
 
-  entry = get_layer_cache_entry (sink, &snippet_cache);
+  entry = get_layer_cache_entry (sink, snippet_cache);
 
   if (entry == NULL)
     {
       char *source;
 
       source =
-        g_strdup_printf ("vec4\n"
+        g_strdup_printf ("uniform float clutter_gst_packed_width%i;\n"
+                         "\n"
+                         "vec4\n"
                          "clutter_gst_sample_video%i (vec2 UV)\n"
                          "{\n"
+                         "  vec4 texel = texture2D (cogl_sampler%i, UV);\n"
+                         "  vec2 luma = texel.%s;\n"
+                         "  vec2 chroma = texel.%s;\n"
+                         /* Pick the luma of the right half of the texel */
+                         "  float odd = step (0.5, fract (UV.x * clutter_gst_packed_width%i));\n"
+                         "  vec3 yuv = vec3 (mix (luma.x, luma.y, odd), chroma);\n"
                          "  vec4 color;\n"
-                         "  float y = 1.1640625 *\n"
-                         "            (texture2D (cogl_sampler%i, UV).a -\n"
-                         "             0.0625);\n"
-                         "  vec2 uv = texture2D (cogl_sampler%i, UV).rg;\n"
-                         "  uv -= 0.5;\n"
-                         "  float u = uv.x;\n"
-                         "  float v = uv.y;\n"
-                         "  vec3 corrected = clutter_gst_get_corrected_color_from_yuv (vec3 (y, u, v));\n"
-                         "  color.rgb = clutter_gst_default_yuv_to_srgb (corrected);\n"
+                         "  color.rgb = clutter_gst_convert_color (yuv);\n"
                          "  color.a = 1.0;\n"
                          "  return color;\n"
                          "}\n",
-                         priv->custom_start,
-                         priv->custom_start,
-                         priv->custom_start + 1);
+                         priv->video_start,
+                         priv->video_start,
+                         priv->video_start,
+                         luma,
+                         chroma,
+                         priv->video_start);
 
-      entry = add_layer_cache_entry (sink, &snippet_cache, source);
+      entry = add_layer_cache_entry (sink, snippet_cache, source);
       g_free (source);
     }
 
-  setup_pipeline_from_cache_entry (sink, pipeline, entry, 2);
+  setup_pipeline_from_cache_entry (sink, pipeline, entry, 1);
+
+  /* Interpolating between texels would mix up the components */
+  cogl_pipeline_set_layer_filters (pipeline,
+                                   priv->video_start,
+                                   COGL_PIPELINE_FILTER_NEAREST,
+                                   COGL_PIPELINE_FILTER_NEAREST);
+
+  uniform_name = g_strdup_printf ("clutter_gst_packed_width%i",
+                                  priv->video_start);
+  location = cogl_pipeline_get_uniform_location (pipeline, uniform_name);
+  cogl_pipeline_set_uniform_1f (pipeline, location,
+                                (GST_VIDEO_INFO_WIDTH (&priv->info) + 1) / 2);
+  g_free (uniform_name);
+}
+
+static void
+clutter_gst_yuy2_glsl_setup_pipeline (ClutterGstVideoSink *sink,
+                                      CoglPipeline *pipeline)
+{
+  static SnippetCache snippet_cache;
+
+  /* Y0 U Y1 V */
+  clutter_gst_packed_422_glsl_setup_pipeline (sink, pipeline, &snippet_cache,
+                                              "rb", "ga");
+}
+
+static void
+clutter_gst_uyvy_glsl_setup_pipeline (ClutterGstVideoSink *sink,
+                                      CoglPipeline *pipeline)
+{
+  static SnippetCache snippet_cache;
+
+  /* U Y0 V Y1 */
+  clutter_gst_packed_422_glsl_setup_pipeline (sink, pipeline, &snippet_cache,
+                                              "ga", "rb");
+}
+
+static void
+clutter_gst_yvyu_glsl_setup_pipeline (ClutterGstVideoSink *sink,
+                                      CoglPipeline *pipeline)
+{
+  static SnippetCache snippet_cache;
+
+  /* Y0 V Y1 U */
+  clutter_gst_packed_422_glsl_setup_pipeline (sink, pipeline, &snippet_cache,
+                                              "rb", "ag");
 }
 
 static gboolean
-clutter_gst_nv12_upload (ClutterGstVideoSink *sink,
-                         GstBuffer *buffer)
+clutter_gst_packed_422_upload (ClutterGstVideoSink *sink,
+                               GstBuffer *buffer)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
   GstVideoFrame frame;
+  gboolean ret;
 
   if (!gst_video_frame_map (&frame, &priv->info, buffer, GST_MAP_READ))
     goto map_fail;
 
-  clear_frame_textures (sink);
-
-  priv->frame[0] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_INFO_COMP_WIDTH (&priv->info, 0),
-                                 GST_VIDEO_INFO_COMP_HEIGHT (&priv->info, 0),
-                                 COGL_PIXEL_FORMAT_A_8,
-                                 priv->info.stride[0],
-                                 frame.data[0]);
-
-  priv->frame[1] =
-    video_texture_new_from_data (priv->ctx,
-                                 GST_VIDEO_INFO_COMP_WIDTH (&priv->info, 1),
-                                 GST_VIDEO_INFO_COMP_HEIGHT (&priv->info, 1),
-                                 COGL_PIXEL_FORMAT_RG_88,
-                                 priv->info.stride[1],
-                                 frame.data[1]);
+  /* The data is uploaded as is, claiming it is premultiplied keeps Cogl
+   * from touching the components */
+  ret = video_texture_upload (sink, 0,
+                              (GST_VIDEO_FRAME_WIDTH (&frame) + 1) / 2,
+                              GST_VIDEO_FRAME_HEIGHT (&frame),
+                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                              GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+                              GST_VIDEO_FRAME_PLANE_DATA (&frame, 0));
 
   gst_video_frame_unmap (&frame);
 
-  return TRUE;
+  return ret;
 
  map_fail:
   {
@@ -1686,16 +3558,44 @@ clutter_gst_nv12_upload (ClutterGstVideoSink *sink,
   }
 }
 
-static ClutterGstRenderer nv12_glsl_renderer =
+static ClutterGstRenderer yuy2_glsl_renderer =
   {
-    "NV12 glsl",
-    CLUTTER_GST_NV12,
-    CLUTTER_GST_RENDERER_NEEDS_GLSL | CLUTTER_GST_RENDERER_NEEDS_TEXTURE_RG,
-    GST_STATIC_CAPS (MAKE_CAPS(GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
-                               "NV12")),
-    2, /* n_layers */
-    clutter_gst_nv12_glsl_setup_pipeline,
-    clutter_gst_nv12_upload,
+    "YUY2 glsl",
+    CLUTTER_GST_YUY2,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "YUY2")),
+    1, /* n_layers */
+    clutter_gst_yuy2_glsl_setup_pipeline,
+    clutter_gst_packed_422_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+static ClutterGstRenderer uyvy_glsl_renderer =
+  {
+    "UYVY glsl",
+    CLUTTER_GST_UYVY,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "UYVY")),
+    1, /* n_layers */
+    clutter_gst_uyvy_glsl_setup_pipeline,
+    clutter_gst_packed_422_upload,
+    clutter_gst_dummy_upload_gl,
+    clutter_gst_dummy_shutdown,
+  };
+
+static ClutterGstRenderer yvyu_glsl_renderer =
+  {
+    "YVYU glsl",
+    CLUTTER_GST_YVYU,
+    CLUTTER_GST_RENDERER_NEEDS_GLSL,
+    GST_STATIC_CAPS (MAKE_CAPS (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+                                "YVYU")),
+    1, /* n_layers */
+    clutter_gst_yvyu_glsl_setup_pipeline,
+    clutter_gst_packed_422_upload,
     clutter_gst_dummy_upload_gl,
     clutter_gst_dummy_shutdown,
   };
@@ -1711,12 +3611,21 @@ clutter_gst_build_renderers_list (CoglContext *ctx)
       /* These are in increasing order of priority so that the
        * priv->renderers will be in decreasing order. That way the GLSL
        * renderers will be preferred if they are available */
+      &yuy2_cpu_renderer,
+      &nv12_cpu_renderer,
+      &i420_cpu_renderer,
       &rgb24_renderer,
       &rgb32_renderer,
+      &yvyu_glsl_renderer,
+      &uyvy_glsl_renderer,
+      &yuy2_glsl_renderer,
       &ayuv_glsl_renderer,
-      &nv12_glsl_renderer,
-      &yv12_glsl_renderer,
-      &i420_glsl_renderer,
+      &planar_16_glsl_renderer,
+#if GST_CHECK_VERSION (1, 10, 0)
+      &p010_glsl_renderer,
+#endif
+      &semi_planar_glsl_renderer,
+      &planar_glsl_renderer,
       &rgb24_glsl_renderer,
       &rgb32_glsl_renderer,
       NULL
@@ -1817,7 +3726,8 @@ clutter_gst_video_sink_get_caps (GstBaseSink *bsink,
 static gboolean
 clutter_gst_video_sink_parse_caps (GstCaps *caps,
                                    ClutterGstVideoSink *sink,
-                                   gboolean save)
+                                   gboolean save,
+                                   ClutterGstRenderer **renderer_out)
 {
   ClutterGstVideoSinkPrivate *priv = sink->priv;
   GstCaps *intersection;
@@ -1838,18 +3748,46 @@ clutter_gst_video_sink_parse_caps (GstCaps *caps,
   switch (vinfo.finfo->format)
     {
     case GST_VIDEO_FORMAT_YV12:
-      format = CLUTTER_GST_YV12;
-      break;
     case GST_VIDEO_FORMAT_I420:
-      format = CLUTTER_GST_I420;
+    case GST_VIDEO_FORMAT_Y42B:
+    case GST_VIDEO_FORMAT_Y444:
+    case GST_VIDEO_FORMAT_GRAY8:
+      format = CLUTTER_GST_PLANAR;
       break;
     case GST_VIDEO_FORMAT_AYUV:
       format = CLUTTER_GST_AYUV;
       bgr = FALSE;
       break;
     case GST_VIDEO_FORMAT_NV12:
-      format = CLUTTER_GST_NV12;
+    case GST_VIDEO_FORMAT_NV21:
+    case GST_VIDEO_FORMAT_NV16:
+    case GST_VIDEO_FORMAT_NV61:
+      format = CLUTTER_GST_SEMI_PLANAR;
       break;
+    case GST_VIDEO_FORMAT_YUY2:
+      format = CLUTTER_GST_YUY2;
+      break;
+    case GST_VIDEO_FORMAT_UYVY:
+      format = CLUTTER_GST_UYVY;
+      break;
+    case GST_VIDEO_FORMAT_YVYU:
+      format = CLUTTER_GST_YVYU;
+      break;
+    case GST_VIDEO_FORMAT_I420_10LE:
+    case GST_VIDEO_FORMAT_I422_10LE:
+    case GST_VIDEO_FORMAT_Y444_10LE:
+#if GST_CHECK_VERSION (1, 12, 0)
+    case GST_VIDEO_FORMAT_I420_12LE:
+    case GST_VIDEO_FORMAT_I422_12LE:
+    case GST_VIDEO_FORMAT_Y444_12LE:
+#endif
+      format = CLUTTER_GST_PLANAR_16;
+      break;
+#if GST_CHECK_VERSION (1, 10, 0)
+    case GST_VIDEO_FORMAT_P010_10LE:
+      format = CLUTTER_GST_P010;
+      break;
+#endif
     case GST_VIDEO_FORMAT_RGB:
       format = CLUTTER_GST_RGB24;
       bgr = FALSE;
@@ -1872,102 +3810,502 @@ clutter_gst_video_sink_parse_caps (GstCaps *caps,
       goto unhandled_format;
     }
 
-  renderer = clutter_gst_find_renderer_by_format (sink, format);
+  renderer = clutter_gst_find_renderer_by_format (sink, format);
+
+  if (G_UNLIKELY (renderer == NULL))
+    goto no_suitable_renderer;
+
+  GST_INFO_OBJECT (sink, "found the %s renderer", renderer->name);
+
+  if (renderer_out)
+    *renderer_out = renderer;
+
+  if (save)
+    {
+
+      GST_INFO_OBJECT (sink, "saving infos");
+
+      priv->info = vinfo;
+
+      priv->format = format;
+      priv->bgr = bgr;
+      priv->gl_upload =
+        gst_caps_features_contains (gst_caps_get_features (caps, 0),
+                                    GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META);
+
+      priv->renderer = renderer;
+    }
+
+  return TRUE;
+
+
+ no_intersection:
+  {
+    GST_WARNING_OBJECT (sink,
+                        "Incompatible caps, don't intersect with %" GST_PTR_FORMAT, priv->caps);
+    return FALSE;
+  }
+
+ unknown_format:
+  {
+    GST_WARNING_OBJECT (sink, "Could not figure format of input caps");
+    return FALSE;
+  }
+
+ unhandled_format:
+  {
+    GST_ERROR_OBJECT (sink, "Provided caps aren't supported by clutter-gst");
+    return FALSE;
+  }
+
+ no_suitable_renderer:
+  {
+    GST_ERROR_OBJECT (sink, "could not find a suitable renderer");
+    return FALSE;
+  }
+}
+
+static GstBufferPool *
+clutter_gst_video_sink_new_pool (ClutterGstVideoSink *sink,
+                                 GstCaps *caps,
+                                 guint size,
+                                 guint min_buffers,
+                                 guint max_buffers,
+                                 guint spares)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstBufferPool *pool;
+  GstStructure *config;
+
+  /* Reserves pixel buffers for each configuration it gets */
+  pool = clutter_gst_pixel_buffer_pool_new (spares);
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size,
+                                     min_buffers, max_buffers);
+  gst_buffer_pool_config_set_allocator (config, priv->allocator, NULL);
+  gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  if (!gst_buffer_pool_set_config (pool, config))
+    {
+      GST_WARNING_OBJECT (sink, "failed to configure pixel buffer pool");
+      gst_object_unref (pool);
+      return NULL;
+    }
+
+  return pool;
+}
+
+static void
+clutter_gst_video_sink_clear_staging_pool (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  if (priv->staging_pool)
+    {
+      gst_buffer_pool_set_active (priv->staging_pool, FALSE);
+      gst_object_unref (priv->staging_pool);
+      priv->staging_pool = NULL;
+    }
+}
+
+/* Pool of pixel buffers the streaming thread copies frames into when
+ * upstream didn't use ours, so that the main loop only has to get the
+ * GL driver to transfer them into textures. */
+static void
+clutter_gst_video_sink_setup_staging_pool (ClutterGstVideoSink *sink,
+                                           GstCaps *caps,
+                                           ClutterGstRenderer *renderer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstCapsFeatures *features = gst_caps_get_features (caps, 0);
+
+  clutter_gst_video_sink_clear_staging_pool (sink);
+
+  if (!priv->threaded_upload || priv->allocator == NULL ||
+      clutter_gst_renderer_converts_on_cpu (renderer))
+    return;
+
+  if (!gst_caps_features_contains (features,
+                                   GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY) ||
+      !gst_video_info_from_caps (&priv->staging_info, caps))
+    return;
+
+  /* Enough to fill the frame queue and keep the frame being shown */
+  priv->staging_pool =
+    clutter_gst_video_sink_new_pool (sink, caps, priv->staging_info.size, 0,
+                                     CLUTTER_GST_FRAME_QUEUE_SIZE + 2,
+                                     CLUTTER_GST_FRAME_QUEUE_SIZE + 2);
+
+  if (priv->staging_pool &&
+      !gst_buffer_pool_set_active (priv->staging_pool, TRUE))
+    {
+      GST_WARNING_OBJECT (sink, "failed to activate staging pool");
+      gst_object_unref (priv->staging_pool);
+      priv->staging_pool = NULL;
+    }
+}
+
+/* Copies @buffer into a pixel buffer from the staging pool, returns
+ * NULL if it can't or doesn't need to be */
+static GstBuffer *
+clutter_gst_video_sink_stage_buffer (ClutterGstVideoSink *sink,
+                                     GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstVideoOverlayCompositionMeta *composition_meta;
+  GstVideoAffineTransformationMeta *affine_meta;
+  GstBufferPoolAcquireParams params = { 0, };
+  GstVideoFrame src, dest;
+  GstBuffer *staged = NULL;
+  GstVideoCropMeta *crop_meta;
+  GstVideoMeta *video_meta;
+
+  if (gst_buffer_n_memory (buffer) == 1 &&
+      clutter_gst_is_pixel_buffer_memory (gst_buffer_peek_memory (buffer, 0)))
+    return NULL;
+
+  /* Padded frames are uploaded as they are, the staging buffers only
+   * have room for the size in the caps */
+  video_meta = gst_buffer_get_video_meta (buffer);
+  if (video_meta &&
+      (video_meta->width != GST_VIDEO_INFO_WIDTH (&priv->staging_info) ||
+       video_meta->height != GST_VIDEO_INFO_HEIGHT (&priv->staging_info)))
+    return NULL;
+
+  /* Don't make the streaming thread wait if the main loop is holding
+   * on to all our buffers */
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  if (gst_buffer_pool_acquire_buffer (priv->staging_pool, &staged,
+                                      &params) != GST_FLOW_OK)
+    return NULL;
+
+  /* No point in copying into system memory. The buffer is dropped
+   * from the pool, to get a pixel buffer allocated next time. */
+  if (!clutter_gst_is_pixel_buffer_memory (gst_buffer_peek_memory (staged, 0)))
+    {
+      g_atomic_int_inc (&priv->stats.pbo_fallbacks);
+      GST_BUFFER_FLAG_SET (staged, GST_BUFFER_FLAG_TAG_MEMORY);
+      gst_buffer_unref (staged);
+      return NULL;
+    }
+
+  if (!gst_video_frame_map (&src, &priv->staging_info, buffer, GST_MAP_READ))
+    goto fail;
+
+  if (!gst_video_frame_map (&dest, &priv->staging_info, staged, GST_MAP_WRITE))
+    {
+      gst_video_frame_unmap (&src);
+      goto fail;
+    }
+
+  if (!gst_video_frame_copy (&dest, &src))
+    {
+      gst_video_frame_unmap (&dest);
+      gst_video_frame_unmap (&src);
+      goto fail;
+    }
+
+  gst_video_frame_unmap (&dest);
+  gst_video_frame_unmap (&src);
+
+  GST_BUFFER_PTS (staged) = GST_BUFFER_PTS (buffer);
+  GST_BUFFER_DTS (staged) = GST_BUFFER_DTS (buffer);
+  GST_BUFFER_DURATION (staged) = GST_BUFFER_DURATION (buffer);
+
+  composition_meta = gst_buffer_get_video_overlay_composition_meta (buffer);
+  if (composition_meta)
+    gst_buffer_add_video_overlay_composition_meta (staged,
+                                                   composition_meta->overlay);
+
+  crop_meta = gst_buffer_get_video_crop_meta (buffer);
+  if (crop_meta)
+    {
+      GstVideoCropMeta *staged_crop = gst_buffer_add_video_crop_meta (staged);
+
+      staged_crop->x = crop_meta->x;
+      staged_crop->y = crop_meta->y;
+      staged_crop->width = crop_meta->width;
+      staged_crop->height = crop_meta->height;
+    }
+
+  /* Needed by update_orientation() when the staged copy is shown */
+  affine_meta = gst_buffer_get_video_affine_transformation_meta (buffer);
+  if (affine_meta)
+    {
+      GstVideoAffineTransformationMeta *staged_affine =
+        gst_buffer_add_video_affine_transformation_meta (staged);
+
+      memcpy (staged_affine->matrix, affine_meta->matrix,
+              sizeof (staged_affine->matrix));
+    }
+
+  return staged;
+
+ fail:
+  {
+    GST_DEBUG_OBJECT (sink, "could not stage buffer %p", buffer);
+    gst_buffer_unref (staged);
+    return NULL;
+  }
+}
+
+/* Display latency
+ *
+ * Frames reach the screen some time after basesink renders them: the
+ * main loop has to pick them up, they are uploaded and have to wait
+ * for the stage to be painted and presented. That delay is measured
+ * as how late frames are presented compared to the time they are due,
+ * and fed back into the render delay so that basesink renders them
+ * that much earlier and includes it in the latency it reports. */
+
+static void
+clutter_gst_video_sink_update_render_delay (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstBaseSink *bsink = GST_BASE_SINK (sink);
+  GstClockTime delay, added;
+
+  /* Keeping whatever was set through the "render-delay" property */
+  delay = gst_base_sink_get_render_delay (bsink);
+
+  GST_OBJECT_LOCK (sink);
+  delay = delay > priv->render_delay_added ?
+    delay - priv->render_delay_added : 0;
+  added = priv->render_delay_added = priv->lookahead + priv->display_delay;
+  GST_OBJECT_UNLOCK (sink);
+
+  /* basesink posts a latency message when it changes */
+  gst_base_sink_set_render_delay (bsink, delay + added);
+}
+
+/* Called from the main loop with the lateness of a frame once it is
+ * known when it reached the screen */
+static void
+clutter_gst_video_sink_add_lateness (ClutterGstVideoSink *sink,
+                                     GstClockTimeDiff lateness)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstClockTimeDiff mean, delay;
+
+  priv->lateness_sum += lateness;
+  if (++priv->lateness_count < DISPLAY_DELAY_WINDOW)
+    return;
+
+  mean = priv->lateness_sum / (GstClockTimeDiff) priv->lateness_count;
+  priv->lateness_sum = 0;
+  priv->lateness_count = 0;
+
+  if (ABS (mean) < DISPLAY_DELAY_THRESHOLD)
+    return;
+
+  GST_OBJECT_LOCK (sink);
+  delay = CLAMP ((GstClockTimeDiff) priv->display_delay + mean,
+                 0, MAX_DISPLAY_DELAY);
+  if ((GstClockTime) delay == priv->display_delay)
+    {
+      GST_OBJECT_UNLOCK (sink);
+      return;
+    }
+  priv->display_delay = delay;
+  GST_OBJECT_UNLOCK (sink);
+
+  GST_INFO_OBJECT (sink, "frames presented %" G_GINT64_FORMAT " ns late on "
+                   "average, display delay now %" GST_TIME_FORMAT,
+                   mean, GST_TIME_ARGS (delay));
+
+  clutter_gst_video_sink_update_render_delay (sink);
+}
+
+static gboolean
+clutter_gst_video_sink_set_caps (GstBaseSink *bsink,
+                                 GstCaps *caps)
+{
+  ClutterGstVideoSink *sink;
+  ClutterGstVideoSinkPrivate *priv;
+  ClutterGstRenderer *renderer;
+
+  sink = CLUTTER_GST_VIDEO_SINK (bsink);
+  priv = sink->priv;
+
+  GST_INFO_OBJECT (bsink, "Setting caps to %" GST_PTR_FORMAT, caps);
+
+  if (!clutter_gst_video_sink_parse_caps (caps, sink, FALSE, &renderer))
+    return FALSE;
+
+  clutter_gst_video_sink_setup_staging_pool (sink, caps, renderer);
+
+  /* Have basesink hand frames over two frames ahead of time, so that
+   * the one due at each vblank is already queued when the stage is
+   * painted. The delay is accounted for in the latency we report. */
+  if (priv->vblank_aligned)
+    {
+      GstVideoInfo info;
+      GstClockTime lookahead = 2 * DEFAULT_REFRESH_INTERVAL;
+
+      if (gst_video_info_from_caps (&info, caps) && info.fps_n > 0)
+        lookahead = 2 * gst_util_uint64_scale_int (GST_SECOND, info.fps_d,
+                                                   info.fps_n);
+
+      GST_OBJECT_LOCK (sink);
+      priv->lookahead = lookahead;
+      GST_OBJECT_UNLOCK (sink);
+
+      clutter_gst_video_sink_update_render_delay (sink);
+    }
+
+  /* Sent along with the next frame */
+  gst_caps_replace (&priv->source->pending_caps, caps);
+
+  return TRUE;
+}
 
-  if (G_UNLIKELY (renderer == NULL))
-    goto no_suitable_renderer;
+static gboolean
+clutter_gst_video_sink_upload_buffer (ClutterGstVideoSink *sink,
+                                      GstBuffer *buffer)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstMemory *mem;
 
-  GST_INFO_OBJECT (sink, "found the %s renderer", renderer->name);
+  /* The transfers out of the pixel buffers of the previous frame are
+   * done by now, they can be handed back to upstream */
+  if (priv->allocator)
+    clutter_gst_pixel_buffer_allocator_map_uploaded (priv->allocator);
 
-  if (save)
+  if (gst_buffer_get_video_gl_texture_upload_meta (buffer) != NULL)
     {
+      GST_DEBUG_OBJECT (sink, "Trying to upload buffer %p with GL", buffer);
+      return priv->renderer->upload_gl (sink, buffer);
+    }
 
-      GST_INFO_OBJECT (sink, "saving infos");
+  mem = gst_buffer_peek_memory (buffer, 0);
 
-      priv->info = vinfo;
+  if (gst_buffer_n_memory (buffer) == 1 &&
+      clutter_gst_is_pixel_buffer_memory (mem))
+    {
+      gboolean ret;
 
-      priv->format = format;
-      priv->bgr = bgr;
+      GST_DEBUG_OBJECT (sink, "Trying to upload buffer %p from pixel buffer",
+                        buffer);
 
-      priv->renderer = renderer;
-    }
+      /* Let the renderer map the frame and compute its planes as usual,
+       * the planes going into existing textures are recorded and
+       * uploaded from the pixel buffer afterwards. */
+      priv->defer_uploads = TRUE;
+      priv->n_pending = 0;
+      ret = priv->renderer->upload (sink, buffer);
+      priv->defer_uploads = FALSE;
 
-  return TRUE;
+      if (!ret)
+        return FALSE;
 
+      if (priv->n_pending == 0)
+        {
+          /* Only new textures, they got their data at allocation */
+          GST_LOG_OBJECT (sink, "buffer %p copied (new textures)", buffer);
+          g_atomic_int_inc (&priv->stats.copy_uploads);
+          return TRUE;
+        }
 
- no_intersection:
-  {
-    GST_WARNING_OBJECT (sink,
-                        "Incompatible caps, don't intersect with %" GST_PTR_FORMAT, priv->caps);
-    return FALSE;
-  }
+      if (video_texture_upload_pending (sink, mem))
+        {
+          GST_LOG_OBJECT (sink, "buffer %p uploaded from pixel buffer", buffer);
+          g_atomic_int_inc (&priv->stats.pbo_uploads);
+          return TRUE;
+        }
 
- unknown_format:
-  {
-    GST_WARNING_OBJECT (sink, "Could not figure format of input caps");
-    return FALSE;
-  }
+      GST_DEBUG_OBJECT (sink, "pixel buffer of %p unavailable, copying",
+                        buffer);
+    }
+  else
+    {
+      GST_DEBUG_OBJECT (sink, "Trying to upload buffer %p with software",
+                        buffer);
 
- unhandled_format:
-  {
-    GST_ERROR_OBJECT (sink, "Provided caps aren't supported by clutter-gst");
-    return FALSE;
-  }
+      /* Allocated from our pool when no pixel buffer was ready, have
+       * the pool drop it when it gets it back instead of recycling it */
+      if (buffer->pool != NULL && buffer->pool == priv->pool)
+        {
+          g_atomic_int_inc (&priv->stats.pbo_fallbacks);
+          GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+        }
+    }
 
- no_suitable_renderer:
-  {
-    GST_ERROR_OBJECT (sink, "could not find a suitable renderer");
+  if (!priv->renderer->upload (sink, buffer))
     return FALSE;
-  }
+
+  GST_LOG_OBJECT (sink, "buffer %p copied", buffer);
+  g_atomic_int_inc (&priv->stats.copy_uploads);
+
+  return TRUE;
 }
 
+/* Whether @buffer wraps the same memory, at the same offsets, as the
+ * buffer last uploaded, as still images and paused streams do. Since
+ * we hold a reference on that buffer, its memory is locked and can't
+ * have been written to since; comparing pointers alone would take a
+ * pooled buffer refilled with a new frame for a repeat. That reference
+ * is accounted for in MIN_BUFFERS. */
 static gboolean
-clutter_gst_video_sink_set_caps (GstBaseSink *bsink,
-                                 GstCaps *caps)
+clutter_gst_video_sink_is_repeated_buffer (ClutterGstVideoSink *sink,
+                                           GstBuffer *buffer)
 {
-  ClutterGstVideoSink *sink;
-  ClutterGstVideoSinkPrivate *priv;
+  GstBuffer *last = sink->priv->last_buffer;
+  GstVideoMeta *meta, *last_meta;
+  guint i, n_memory;
 
-  sink = CLUTTER_GST_VIDEO_SINK (bsink);
-  priv = sink->priv;
+  if (last == NULL)
+    return FALSE;
 
-  GST_INFO_OBJECT (bsink, "Setting caps to %" GST_PTR_FORMAT, caps);
+  if (buffer == last)
+    return TRUE;
 
-  if (!clutter_gst_video_sink_parse_caps (caps, sink, FALSE))
+  n_memory = gst_buffer_n_memory (buffer);
+  if (n_memory != gst_buffer_n_memory (last) ||
+      gst_buffer_get_size (buffer) != gst_buffer_get_size (last))
     return FALSE;
 
-  g_mutex_lock (&priv->source->buffer_lock);
-  priv->source->has_new_caps = TRUE;
-  g_mutex_unlock (&priv->source->buffer_lock);
+  for (i = 0; i < n_memory; i++)
+    if (gst_buffer_peek_memory (buffer, i) != gst_buffer_peek_memory (last, i))
+      return FALSE;
 
-  return TRUE;
+  meta = gst_buffer_get_video_meta (buffer);
+  last_meta = gst_buffer_get_video_meta (last);
+
+  if (meta == NULL || last_meta == NULL)
+    return meta == last_meta;
+
+  return (memcmp (meta->offset, last_meta->offset, sizeof (meta->offset)) == 0 &&
+          memcmp (meta->stride, last_meta->stride, sizeof (meta->stride)) == 0);
 }
 
+/* Uploads the newest queued frame due by @deadline, returns FALSE if
+ * the sink can't carry on */
 static gboolean
-clutter_gst_source_dispatch (GSource *source,
-                             GSourceFunc callback,
-                             void *user_data)
+clutter_gst_video_sink_present_frame (ClutterGstVideoSink *sink,
+                                      GstClockTime deadline)
 {
-  ClutterGstSource *gst_source= (ClutterGstSource*) source;
-  ClutterGstVideoSinkPrivate *priv = gst_source->sink->priv;
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstSource *gst_source = priv->source;
   GstBuffer *buffer;
+  GstCaps *caps;
+  ClutterGstQueuedFrame popped = { NULL, };
   gboolean pipeline_ready = FALSE;
+  gboolean new_frame = FALSE;
 
-  g_mutex_lock (&gst_source->buffer_lock);
+  buffer = clutter_gst_source_pop_frame (gst_source, &caps, &popped,
+                                         deadline);
 
-  if (G_UNLIKELY (gst_source->has_new_caps))
+  if (G_UNLIKELY (caps != NULL))
     {
-      GstCaps *caps =
-        gst_pad_get_current_caps (GST_BASE_SINK_PAD ((GST_BASE_SINK
-                                                      (gst_source->sink))));
-
-      if (!clutter_gst_video_sink_parse_caps (caps, gst_source->sink, TRUE))
+      if (!clutter_gst_video_sink_parse_caps (caps, sink, TRUE, NULL))
         goto negotiation_fail;
 
-      gst_source->has_new_caps = FALSE;
+      gst_caps_unref (caps);
+      g_atomic_int_inc (&priv->stats.renegotiations);
 
-      clear_frame_textures (gst_source->sink);
-      dirty_default_pipeline (gst_source->sink);
+      clear_frame_textures (sink);
+      dirty_default_pipeline (sink);
 
       /* We are now in a state where we could generate the pipeline if
        * the application requests it so we can emit the signal.
@@ -1976,41 +4314,73 @@ clutter_gst_source_dispatch (GSource *source,
       pipeline_ready = TRUE;
     }
 
-  buffer = gst_source->buffer;
-  gst_source->buffer = NULL;
+  if (buffer && clutter_gst_video_sink_update_crop (sink, buffer))
+    new_frame = TRUE;
+
+  if (buffer && clutter_gst_video_sink_update_orientation (sink, buffer))
+    new_frame = TRUE;
 
-  g_mutex_unlock (&gst_source->buffer_lock);
+  if (buffer && clutter_gst_video_sink_is_repeated_buffer (sink, buffer))
+    {
+      GST_LOG_OBJECT (sink, "buffer %p repeats the frame displayed, "
+                      "skipping its upload", buffer);
+      g_atomic_int_inc (&priv->stats.repeated);
 
-  if (buffer)
+      /* The overlays might have changed all the same */
+      clutter_gst_video_sink_upload_overlay (sink, buffer);
+      gst_buffer_unref (buffer);
+    }
+  else if (buffer)
     {
-      clutter_gst_video_sink_upload_overlay (gst_source->sink, buffer);
+      ClutterGstTiming *timing;
+      gint64 start, end;
+
+      start = g_get_monotonic_time ();
+
+      clutter_gst_video_sink_upload_overlay (sink, buffer);
+
+      if (!clutter_gst_video_sink_upload_buffer (sink, buffer))
+        goto fail_upload;
 
-      if (gst_buffer_get_video_gl_texture_upload_meta (buffer) != NULL) {
-        GST_DEBUG_OBJECT (gst_source->sink,
-                          "Trying to upload buffer %p with GL", buffer);
-        if (!priv->renderer->upload_gl (gst_source->sink, buffer)) {
-          goto fail_upload;
+      end = g_get_monotonic_time ();
+
+      GST_OBJECT_LOCK (sink);
+      timing = g_hash_table_lookup (priv->upload_timings, priv->renderer);
+      if (timing == NULL)
+        {
+          timing = g_new0 (ClutterGstTiming, 1);
+          g_hash_table_insert (priv->upload_timings, priv->renderer, timing);
         }
-      } else {
-        GST_DEBUG_OBJECT (gst_source->sink,
-                          "Trying to upload buffer %p with software", buffer);
-        if (!priv->renderer->upload (gst_source->sink, buffer))
-          goto fail_upload;
-      }
+      clutter_gst_timing_add (timing, (end - start) * GST_USECOND);
+      clutter_gst_timing_add (&priv->dispatch_latency,
+                              (start - popped.queued_time) * GST_USECOND);
+      GST_OBJECT_UNLOCK (sink);
 
+      g_atomic_int_inc (&priv->stats.uploaded);
       priv->had_upload_once = TRUE;
+      new_frame = TRUE;
+
+      priv->qos_pending = TRUE;
+      priv->qos_flush_seqnum = popped.flush_seqnum;
+      priv->qos_running_time = popped.running_time;
+      priv->qos_duration = popped.duration;
 
+      gst_buffer_replace (&priv->last_buffer, buffer);
       gst_buffer_unref (buffer);
     }
   else
-    GST_WARNING_OBJECT (gst_source->sink, "No buffers available for display");
+    GST_DEBUG_OBJECT (sink, "No buffers available for display");
 
   if (G_UNLIKELY (pipeline_ready))
-    g_signal_emit (gst_source->sink,
+    g_signal_emit (sink,
                    video_sink_signals[PIPELINE_READY],
                    0 /* detail */);
-  if (priv->had_upload_once)
-    g_signal_emit (gst_source->sink,
+
+  /* Only have the frame repainted if it actually changed, or if the
+   * color balance needs to be applied to it */
+  if (priv->had_upload_once &&
+      (new_frame || pipeline_ready || priv->balance_dirty))
+    g_signal_emit (sink,
                    video_sink_signals[NEW_FRAME], 0,
                    NULL);
 
@@ -2019,23 +4389,392 @@ clutter_gst_source_dispatch (GSource *source,
 
  negotiation_fail:
   {
-    GST_WARNING_OBJECT (gst_source->sink,
-                        "Failed to handle caps. Stopping GSource");
-    priv->flow_return = GST_FLOW_NOT_NEGOTIATED;
-    g_mutex_unlock (&gst_source->buffer_lock);
+    GST_WARNING_OBJECT (sink,
+                        "Failed to handle caps. Stopping updates");
+    g_atomic_int_set (&priv->flow_return, GST_FLOW_NOT_NEGOTIATED);
+    gst_caps_unref (caps);
+    if (buffer)
+      gst_buffer_unref (buffer);
 
     return FALSE;
   }
 
  fail_upload:
   {
-    GST_WARNING_OBJECT (gst_source->sink, "Failed to upload buffer");
-    priv->flow_return = GST_FLOW_ERROR;
+    GST_WARNING_OBJECT (sink, "Failed to upload buffer");
+    g_atomic_int_inc (&priv->stats.upload_failures);
+    g_atomic_int_set (&priv->flow_return, GST_FLOW_ERROR);
+    gst_buffer_replace (&priv->last_buffer, NULL);
     gst_buffer_unref (buffer);
     return FALSE;
   }
 }
 
+/* A single stage redraw is enough to run the pre-paint function, only
+ * the stage the video is shown on is redrawn, or the default one until
+ * the video gets painted, as clutter_gst_video_sink_get_stage_timing()
+ * does */
+static void
+clutter_gst_video_sink_ensure_redraw (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterStage *stage = priv->paint_stage;
+
+  if (stage == NULL)
+    stage = clutter_stage_manager_get_default_stage (clutter_stage_manager_get_default ());
+
+  if (stage != NULL)
+    clutter_stage_ensure_redraw (stage);
+
+  priv->source->redraw_queued = TRUE;
+}
+
+static void clutter_gst_video_sink_setup_clutter (ClutterGstVideoSink *sink);
+
+static gboolean
+clutter_gst_source_dispatch (GSource *source,
+                             GSourceFunc callback,
+                             void *user_data)
+{
+  ClutterGstSource *gst_source= (ClutterGstSource*) source;
+  ClutterGstVideoSink *sink = gst_source->sink;
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  /* The frames are uploaded and their timing is shared with the repaint
+   * functions and the "presented" handlers without any locking, which
+   * only works from the thread Clutter runs in. That thread owns the
+   * default context as long as its main loop is running. */
+  if (G_UNLIKELY (!g_main_context_is_owner (g_main_context_default ())))
+    {
+      GST_ELEMENT_ERROR (sink, RESOURCE, FAILED,
+                         ("The main context is not iterated from the "
+                          "thread Clutter runs in"), (NULL));
+      g_atomic_int_set (&priv->flow_return, GST_FLOW_ERROR);
+      return FALSE;
+    }
+
+  if (G_UNLIKELY (!g_atomic_int_get (&priv->clutter_setup)))
+    clutter_gst_video_sink_setup_clutter (sink);
+
+  if (priv->repaint_func_id == 0)
+    return clutter_gst_video_sink_present_frame (sink, GST_CLOCK_TIME_NONE);
+
+  /* The frame will be picked up by the pre-paint hook of the next
+   * stage frame, just make sure there is one. */
+  clutter_gst_video_sink_ensure_redraw (sink);
+
+  return TRUE;
+}
+
+#if CLUTTER_CHECK_VERSION (1, 22, 0)
+static void
+clutter_gst_video_sink_presented (ClutterStage *stage,
+                                  CoglFrameEvent frame_event,
+                                  CoglFrameInfo *frame_info,
+                                  ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstStageTiming *timing;
+  int64_t presentation_time;
+  float refresh_rate;
+
+  if (frame_event != COGL_FRAME_EVENT_COMPLETE)
+    return;
+
+  timing = g_hash_table_lookup (priv->stage_timings, stage);
+  if (timing == NULL)
+    return;
+
+  /* Both are 0 when the winsys can't tell */
+  presentation_time = cogl_frame_info_get_presentation_time (frame_info);
+  refresh_rate = cogl_frame_info_get_refresh_rate (frame_info);
+
+  if (presentation_time > 0)
+    timing->last_presentation = presentation_time;
+  if (refresh_rate > 0)
+    timing->refresh_interval = GST_SECOND / refresh_rate;
+
+  if (presentation_time <= 0)
+    return;
+
+  timing->presentation_known = TRUE;
+
+  if (priv->lateness_pending && priv->lateness_stage == stage)
+    {
+      priv->lateness_pending = FALSE;
+      clutter_gst_video_sink_add_lateness (sink, priv->pending_lateness +
+                                           presentation_time -
+                                           priv->paint_clock_time);
+    }
+}
+#endif
+
+static void
+clutter_gst_stage_timing_free (ClutterGstStageTiming *timing)
+{
+  if (timing->presented_id)
+    g_signal_handler_disconnect (timing->stage, timing->presented_id);
+
+  g_slice_free (ClutterGstStageTiming, timing);
+}
+
+static void
+clutter_gst_video_sink_stage_added (ClutterStageManager *manager,
+                                    ClutterStage *stage,
+                                    ClutterGstVideoSink *sink)
+{
+  ClutterGstStageTiming *timing;
+
+  timing = g_slice_new0 (ClutterGstStageTiming);
+  timing->stage = stage;
+  timing->refresh_interval = DEFAULT_REFRESH_INTERVAL;
+#if CLUTTER_CHECK_VERSION (1, 22, 0)
+  timing->presented_id =
+    g_signal_connect (stage, "presented",
+                      G_CALLBACK (clutter_gst_video_sink_presented), sink);
+#endif
+
+  g_hash_table_insert (sink->priv->stage_timings, stage, timing);
+}
+
+static void
+clutter_gst_video_sink_stage_removed (ClutterStageManager *manager,
+                                      ClutterStage *stage,
+                                      ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  if (priv->paint_stage == stage)
+    priv->paint_stage = NULL;
+
+  if (priv->lateness_stage == stage)
+    priv->lateness_pending = FALSE;
+
+  g_hash_table_remove (priv->stage_timings, stage);
+}
+
+/* Timing of the stage the video was last painted on, or of the default
+ * stage until it has been painted. NULL when neither is tracked. */
+static ClutterGstStageTiming *
+clutter_gst_video_sink_get_stage_timing (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterStage *stage = priv->paint_stage;
+
+  if (stage == NULL)
+    stage = clutter_stage_manager_get_default_stage (clutter_stage_manager_get_default ());
+
+  if (stage == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (priv->stage_timings, stage);
+}
+
+/* Called by the contents painting the video, so the vblank deadline and
+ * the display delay follow the stage it is actually shown on */
+void
+clutter_gst_video_sink_set_paint_stage (ClutterGstVideoSink *sink,
+                                        ClutterStage        *stage)
+{
+  g_return_if_fail (CLUTTER_GST_IS_VIDEO_SINK (sink));
+
+  sink->priv->paint_stage = stage;
+}
+
+/* Returns the running time of the frames due at the vblank the stage
+ * frame about to be painted will be presented at, in the middle of
+ * the refresh interval it will stay on screen for. Without a known
+ * presentation time the vblank is assumed to be one refresh interval
+ * away. */
+static GstClockTime
+clutter_gst_video_sink_get_vblank_deadline (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstBaseSink *bsink = GST_BASE_SINK (sink);
+  ClutterGstStageTiming *timing;
+  GstClock *clock;
+  GstClockTime now, vblank, start;
+  gint64 cogl_now, cogl_vblank, interval, last_presentation;
+
+  clock = gst_element_get_clock (GST_ELEMENT (sink));
+  if (clock == NULL)
+    return GST_CLOCK_TIME_NONE;
+
+  now = gst_clock_get_time (clock);
+  cogl_now = cogl_get_clock_time (priv->ctx);
+  gst_object_unref (clock);
+
+  timing = clutter_gst_video_sink_get_stage_timing (sink);
+  if (timing)
+    {
+      interval = timing->refresh_interval;
+      last_presentation = timing->last_presentation;
+    }
+  else
+    {
+      interval = DEFAULT_REFRESH_INTERVAL;
+      last_presentation = 0;
+    }
+
+  if (last_presentation > 0 && last_presentation <= cogl_now)
+    cogl_vblank = last_presentation +
+      ((cogl_now - last_presentation) / interval + 1) * interval;
+  else
+    cogl_vblank = cogl_now + interval;
+
+  vblank = now + (cogl_vblank - cogl_now) + interval / 2;
+  start = gst_element_get_base_time (GST_ELEMENT (sink)) +
+    gst_base_sink_get_latency (bsink);
+
+  return vblank > start ? vblank - start : 0;
+}
+
+static gboolean
+clutter_gst_video_sink_pre_paint (gpointer user_data)
+{
+  ClutterGstVideoSink *sink = user_data;
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstSource *gst_source = priv->source;
+  GstClockTime deadline = GST_CLOCK_TIME_NONE;
+
+  if (!gst_source->redraw_queued)
+    return TRUE;
+
+  gst_source->redraw_queued = FALSE;
+
+  if (priv->vblank_aligned)
+    deadline = clutter_gst_video_sink_get_vblank_deadline (sink);
+
+  if (!clutter_gst_video_sink_present_frame (sink, deadline))
+    {
+      priv->repaint_func_id = 0;
+      return FALSE;
+    }
+
+  /* Frames due at later vblanks are left in the queue */
+  if (clutter_gst_source_n_queued (gst_source) > 0)
+    clutter_gst_video_sink_ensure_redraw (sink);
+
+  return TRUE;
+}
+
+/* Called after each stage frame. Compares the time the last presented
+ * frame reached the screen with the time it was due and sends the
+ * result upstream, so that decoders skip frames when the main loop
+ * can't keep up. A frame counts as late only if it got painted after
+ * the next one was due. */
+static gboolean
+clutter_gst_video_sink_post_paint (gpointer user_data)
+{
+  ClutterGstVideoSink *sink = user_data;
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstBaseSink *bsink = GST_BASE_SINK (sink);
+  ClutterGstStageTiming *timing;
+  GstClock *clock;
+  GstClockTime now, due, slack, throttle;
+  GstClockTimeDiff lateness, jitter;
+  gdouble proportion;
+  GstEvent *event;
+
+  if (!priv->qos_pending)
+    return TRUE;
+
+  priv->qos_pending = FALSE;
+
+  /* The running time of the frame means nothing anymore after a flush */
+  if (priv->qos_flush_seqnum != g_atomic_int_get (&priv->source->flush_seqnum) ||
+      !GST_CLOCK_TIME_IS_VALID (priv->qos_running_time) ||
+      !gst_base_sink_get_sync (bsink))
+    {
+      priv->cadence_last_paint = GST_CLOCK_TIME_NONE;
+      return TRUE;
+    }
+
+  clock = gst_element_get_clock (GST_ELEMENT (sink));
+  if (clock == NULL)
+    return TRUE;
+
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  if (GST_CLOCK_TIME_IS_VALID (priv->cadence_last_paint) &&
+      priv->qos_running_time > priv->cadence_last_running_time)
+    {
+      GstClockTimeDiff error =
+        GST_CLOCK_DIFF (priv->cadence_last_paint, now) -
+        GST_CLOCK_DIFF (priv->cadence_last_running_time,
+                        priv->qos_running_time);
+
+      GST_OBJECT_LOCK (sink);
+      clutter_gst_timing_add (&priv->cadence, ABS (error));
+      GST_OBJECT_UNLOCK (sink);
+    }
+
+  priv->cadence_last_paint = now;
+  priv->cadence_last_running_time = priv->qos_running_time;
+
+  due = gst_element_get_base_time (GST_ELEMENT (sink)) +
+    priv->qos_running_time + gst_base_sink_get_latency (bsink);
+  lateness = GST_CLOCK_DIFF (due, now);
+
+  if (GST_CLOCK_TIME_IS_VALID (priv->qos_duration) && priv->qos_duration > 0)
+    slack = priv->qos_duration;
+  else if (gst_base_sink_get_max_lateness (bsink) > 0)
+    slack = gst_base_sink_get_max_lateness (bsink);
+  else
+    slack = DEFAULT_QOS_SLACK;
+
+  jitter = lateness - (GstClockTimeDiff) slack;
+
+  /* Wait for the stage to tell when the frame actually got on screen */
+  timing = clutter_gst_video_sink_get_stage_timing (sink);
+  if (timing && timing->presentation_known)
+    {
+      priv->lateness_stage = timing->stage;
+      priv->paint_clock_time = cogl_get_clock_time (priv->ctx);
+      priv->pending_lateness = lateness;
+      priv->lateness_pending = TRUE;
+    }
+  else
+    clutter_gst_video_sink_add_lateness (sink, lateness);
+
+  GST_OBJECT_LOCK (sink);
+  priv->qos_proportion =
+    (7 * priv->qos_proportion +
+     (gdouble) (slack + MAX (jitter, 0)) / slack) / 8;
+  proportion = priv->qos_proportion;
+  clutter_gst_timing_add (&priv->paint_lateness, MAX (lateness, 0));
+  GST_OBJECT_UNLOCK (sink);
+
+  if (jitter > 0)
+    g_atomic_int_inc (&priv->stats.late);
+
+  GST_LOG_OBJECT (sink, "frame at %" GST_TIME_FORMAT " painted with jitter %"
+                  G_GINT64_FORMAT ", proportion %f",
+                  GST_TIME_ARGS (priv->qos_running_time), jitter, proportion);
+
+  if (!g_atomic_int_get (&priv->qos_enabled))
+    return TRUE;
+
+  /* As basesink would do with its throttle time, frames painted on
+   * time ask upstream to skip the ones exceeding the maximum rate */
+  throttle = gst_base_sink_get_throttle_time (bsink);
+
+  if (jitter > 0)
+    event = gst_event_new_qos (GST_QOS_TYPE_OVERFLOW, proportion, jitter,
+                               priv->qos_running_time);
+  else if (throttle > 0)
+    event = gst_event_new_qos (GST_QOS_TYPE_THROTTLE, proportion, throttle,
+                               priv->qos_running_time);
+  else
+    event = gst_event_new_qos (GST_QOS_TYPE_UNDERFLOW, proportion, jitter,
+                               priv->qos_running_time);
+
+  gst_pad_push_event (GST_BASE_SINK_PAD (sink), event);
+
+  return TRUE;
+}
+
 static GSourceFuncs gst_source_funcs =
   {
     clutter_gst_source_prepare,
@@ -2057,8 +4796,6 @@ clutter_gst_source_new (ClutterGstVideoSink *sink)
   g_source_set_priority (source, CLUTTER_GST_DEFAULT_PRIORITY);
 
   gst_source->sink = sink;
-  g_mutex_init (&gst_source->buffer_lock);
-  gst_source->buffer = NULL;
 
   return gst_source;
 }
@@ -2073,20 +4810,39 @@ clutter_gst_video_sink_init (ClutterGstVideoSink *sink)
                                                    ClutterGstVideoSinkPrivate);
   priv->custom_start = 0;
   priv->default_sample = TRUE;
+  priv->gl_texture_ring_size = DEFAULT_GL_TEXTURE_RING_SIZE;
 
   priv->brightness = DEFAULT_BRIGHTNESS;
   priv->contrast = DEFAULT_CONTRAST;
   priv->hue = DEFAULT_HUE;
   priv->saturation = DEFAULT_SATURATION;
 
-  priv->tabley = g_new0 (guint8, 256);
-  priv->tableu = g_new0 (guint8, 256 * 256);
-  priv->tablev = g_new0 (guint8, 256 * 256);
 
   priv->ctx = clutter_gst_get_cogl_context ();
   priv->renderers = clutter_gst_build_renderers_list (priv->ctx);
   priv->caps = clutter_gst_build_caps (priv->renderers);
   priv->overlays = clutter_gst_overlays_new ();
+  priv->overlay_cache =
+    g_hash_table_new_full (NULL, NULL, NULL,
+                           (GDestroyNotify) clutter_gst_atlas_entry_free);
+  priv->atlas_max_size = OVERLAY_ATLAS_MAX_SIZE;
+  priv->upload_timings = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                NULL, g_free);
+  priv->stage_timings =
+    g_hash_table_new_full (NULL, NULL, NULL,
+                           (GDestroyNotify) clutter_gst_stage_timing_free);
+
+  /* Upstream can decode straight into pixel buffers if mapping them
+   * is supported, see clutter_gst_video_sink_propose_allocation() */
+  priv->has_pixel_buffers =
+    cogl_has_feature (priv->ctx, COGL_FEATURE_ID_PBOS) &&
+    cogl_has_feature (priv->ctx, COGL_FEATURE_ID_MAP_BUFFER_FOR_READ) &&
+    cogl_has_feature (priv->ctx, COGL_FEATURE_ID_MAP_BUFFER_FOR_WRITE);
+
+  /* Only the QoS events sent once frames are painted reach upstream,
+   * see clutter_gst_video_sink_post_paint() */
+  priv->qos_enabled = gst_base_sink_is_qos_enabled (GST_BASE_SINK (sink));
+  gst_base_sink_set_qos_enabled (GST_BASE_SINK (sink), FALSE);
 }
 
 static GstFlowReturn
@@ -2096,27 +4852,45 @@ _clutter_gst_video_sink_render (GstBaseSink *bsink,
   ClutterGstVideoSink *sink = CLUTTER_GST_VIDEO_SINK (bsink);
   ClutterGstVideoSinkPrivate *priv = sink->priv;
   ClutterGstSource *gst_source = priv->source;
+  GstFlowReturn flow_return = g_atomic_int_get (&priv->flow_return);
+  GstBuffer *staged = NULL;
+  GstClockTime running_time;
 
-  g_mutex_lock (&gst_source->buffer_lock);
+  if (G_UNLIKELY (flow_return != GST_FLOW_OK))
+    return flow_return;
 
-  if (G_UNLIKELY (priv->flow_return != GST_FLOW_OK))
-    goto dispatch_flow_ret;
+  g_atomic_int_inc (&priv->stats.rendered);
 
-  if (gst_source->buffer)
-    gst_buffer_unref (gst_source->buffer);
+  running_time = gst_segment_to_running_time (&bsink->segment,
+                                              GST_FORMAT_TIME,
+                                              GST_BUFFER_PTS (buffer));
 
-  gst_source->buffer = gst_buffer_ref (buffer);
-  g_mutex_unlock (&gst_source->buffer_lock);
+  if (priv->staging_pool &&
+      gst_buffer_get_video_gl_texture_upload_meta (buffer) == NULL)
+    staged = clutter_gst_video_sink_stage_buffer (sink, buffer);
 
-  g_main_context_wakeup (NULL);
+  if (staged)
+    {
+      GST_LOG_OBJECT (sink, "staged buffer %p into %p", buffer, staged);
+      g_atomic_int_inc (&priv->stats.staged);
+      buffer = staged;
+    }
 
-  return GST_FLOW_OK;
+  if (!clutter_gst_source_push_frame (gst_source, buffer, running_time))
+    {
+      GST_DEBUG_OBJECT (sink, "Frame queue full, dropping buffer %p", buffer);
+      g_atomic_int_inc (&priv->stats.overflowed);
+      clutter_gst_video_sink_post_dropped (sink, GST_BUFFER_PTS (buffer),
+                                           running_time,
+                                           GST_BUFFER_DURATION (buffer));
+    }
 
- dispatch_flow_ret:
-  {
-    g_mutex_unlock (&gst_source->buffer_lock);
-    return priv->flow_return;
-  }
+  if (staged)
+    gst_buffer_unref (staged);
+
+  g_main_context_wakeup (priv->dispatch_context);
+
+  return GST_FLOW_OK;
 }
 
 static GstFlowReturn
@@ -2150,54 +4924,165 @@ clutter_gst_video_sink_dispose (GObject *object)
 
   if (priv->clt_frame)
     {
-      g_boxed_free (CLUTTER_GST_TYPE_FRAME, priv->clt_frame);
+      clutter_gst_frame_unref (priv->clt_frame);
       priv->clt_frame = NULL;
     }
 
+  g_clear_pointer (&priv->last_composition,
+                   gst_video_overlay_composition_unref);
+  g_hash_table_remove_all (priv->overlay_cache);
+  g_clear_pointer (&priv->atlas, cogl_object_unref);
+  g_clear_pointer (&priv->atlas_pipeline, cogl_object_unref);
+  priv->atlas_packer.size = 0;
+
   if (priv->caps)
     {
       gst_caps_unref (priv->caps);
       priv->caps = NULL;
     }
 
-  if (priv->tabley)
+  if (priv->pool)
     {
-      g_free (priv->tabley);
-      priv->tabley = NULL;
+      gst_object_unref (priv->pool);
+      priv->pool = NULL;
     }
 
-  if (priv->tableu)
+  if (priv->allocator)
     {
-      g_free (priv->tableu);
-      priv->tableu = NULL;
+      gst_object_unref (priv->allocator);
+      priv->allocator = NULL;
     }
 
-  if (priv->tablev)
+  if (priv->cpu_converter)
     {
-      g_free (priv->tablev);
-      priv->tablev = NULL;
+      clutter_gst_cpu_converter_free (priv->cpu_converter);
+      priv->cpu_converter = NULL;
     }
 
+  g_clear_pointer (&priv->cpu_rgbx, g_free);
+  priv->cpu_rgbx_size = 0;
+
   G_OBJECT_CLASS (clutter_gst_video_sink_parent_class)->dispose (object);
 }
 
 static void
 clutter_gst_video_sink_finalize (GObject *object)
 {
+  ClutterGstVideoSink *self = CLUTTER_GST_VIDEO_SINK (object);
+
+  g_hash_table_unref (self->priv->upload_timings);
+  g_hash_table_unref (self->priv->stage_timings);
+  g_hash_table_unref (self->priv->overlay_cache);
+
+  if (self->priv->overlays)
+    clutter_gst_overlays_unref (self->priv->overlays);
+
+  if (self->priv->main_context)
+    g_main_context_unref (self->priv->main_context);
+
   G_OBJECT_CLASS (clutter_gst_video_sink_parent_class)->finalize (object);
 }
 
+/* Called from the first dispatch, in Clutter's thread: start() runs in
+ * whatever thread changes the state of the sink, often a streaming
+ * thread, which must not touch the stages nor the state the repaint
+ * functions work on. Only called once the sink has been started. */
+static void
+clutter_gst_video_sink_setup_clutter (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterStageManager *manager = clutter_stage_manager_get_default ();
+  const GSList *l;
+
+  priv->paint_stage = NULL;
+  priv->lateness_stage = NULL;
+  priv->lateness_pending = FALSE;
+  priv->lateness_sum = 0;
+  priv->lateness_count = 0;
+  priv->cadence_last_paint = GST_CLOCK_TIME_NONE;
+  priv->qos_pending = FALSE;
+
+  l = clutter_stage_manager_peek_stages (manager);
+  for (; l != NULL; l = l->next)
+    clutter_gst_video_sink_stage_added (manager, l->data, sink);
+
+  priv->stage_added_id =
+    g_signal_connect (manager, "stage-added",
+                      G_CALLBACK (clutter_gst_video_sink_stage_added), sink);
+  priv->stage_removed_id =
+    g_signal_connect (manager, "stage-removed",
+                      G_CALLBACK (clutter_gst_video_sink_stage_removed), sink);
+
+  /* The repaint functions rely on the stages being tracked */
+  if (priv->upload_on_paint || priv->vblank_aligned)
+    priv->repaint_func_id =
+      clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT,
+                                             clutter_gst_video_sink_pre_paint,
+                                             sink, NULL);
+
+  priv->post_paint_func_id =
+    clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_POST_PAINT,
+                                           clutter_gst_video_sink_post_paint,
+                                           sink, NULL);
+
+  g_atomic_int_set (&priv->clutter_setup, TRUE);
+}
+
 static gboolean
 clutter_gst_video_sink_start (GstBaseSink *base_sink)
 {
   ClutterGstVideoSink *sink = CLUTTER_GST_VIDEO_SINK (base_sink);
   ClutterGstVideoSinkPrivate *priv = sink->priv;
 
-  GST_INFO_OBJECT (sink, "Start");
+  GST_INFO_OBJECT (sink, "Start");
+
+  clutter_gst_video_sink_reset_stats (sink);
+
+  GST_OBJECT_LOCK (sink);
+  if (priv->main_context)
+    priv->dispatch_context = g_main_context_ref (priv->main_context);
+  else
+    priv->dispatch_context = g_main_context_ref (g_main_context_default ());
+  GST_OBJECT_UNLOCK (sink);
+
+  priv->source = clutter_gst_source_new (sink);
+  g_source_attach ((GSource *) priv->source, priv->dispatch_context);
+
+  GST_OBJECT_LOCK (sink);
+  priv->lookahead = 0;
+  priv->display_delay = 0;
+  GST_OBJECT_UNLOCK (sink);
+  clutter_gst_video_sink_update_render_delay (sink);
+
+  priv->tag_orientation = CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY;
+
+  g_atomic_int_set (&priv->flow_return, GST_FLOW_OK);
+
+  /* The pixel buffers are handled from the dispatch context */
+  if (priv->allocator &&
+      CLUTTER_GST_PIXEL_BUFFER_ALLOCATOR (priv->allocator)->context !=
+      priv->dispatch_context)
+    {
+      GST_OBJECT_LOCK (sink);
+      if (priv->pool)
+        {
+          gst_object_unref (priv->pool);
+          priv->pool = NULL;
+        }
+      GST_OBJECT_UNLOCK (sink);
+
+      gst_object_unref (priv->allocator);
+      priv->allocator = NULL;
+    }
+
+  if (priv->has_pixel_buffers && priv->allocator == NULL)
+    priv->allocator =
+      clutter_gst_pixel_buffer_allocator_new (priv->ctx,
+                                              priv->dispatch_context);
+
+  if (priv->allocator)
+    clutter_gst_pixel_buffer_allocator_set_flushing (priv->allocator, FALSE);
 
-  priv->source = clutter_gst_source_new (sink);
-  g_source_attach ((GSource *) priv->source, NULL);
-  priv->flow_return = GST_FLOW_OK;
   return TRUE;
 }
 
@@ -2209,6 +5094,53 @@ clutter_gst_video_sink_stop (GstBaseSink *base_sink)
 
   GST_INFO_OBJECT (sink, "Stop");
 
+  GST_INFO_OBJECT (sink, "texture pool: %i hits, %i misses",
+                   g_atomic_int_get (&priv->stats.texture_pool_hits),
+                   g_atomic_int_get (&priv->stats.texture_pool_misses));
+  GST_INFO_OBJECT (sink, "uploads: %i from pixel buffers, %i copied",
+                   g_atomic_int_get (&priv->stats.pbo_uploads),
+                   g_atomic_int_get (&priv->stats.copy_uploads));
+  GST_INFO_OBJECT (sink, "frames: %i dropped in dispatch, %i dropped on "
+                   "full queue",
+                   g_atomic_int_get (&priv->stats.dropped),
+                   g_atomic_int_get (&priv->stats.overflowed));
+
+  /* Upstream might still be allocating while we are going down, don't
+   * let it wait for the main loop anymore. */
+  if (priv->allocator)
+    clutter_gst_pixel_buffer_allocator_set_flushing (priv->allocator, TRUE);
+
+  clutter_gst_video_sink_clear_staging_pool (sink);
+  gst_buffer_replace (&priv->last_buffer, NULL);
+
+  if (priv->repaint_func_id)
+    {
+      clutter_threads_remove_repaint_func (priv->repaint_func_id);
+      priv->repaint_func_id = 0;
+    }
+
+  if (priv->post_paint_func_id)
+    {
+      clutter_threads_remove_repaint_func (priv->post_paint_func_id);
+      priv->post_paint_func_id = 0;
+    }
+
+  if (priv->stage_added_id)
+    {
+      ClutterStageManager *manager = clutter_stage_manager_get_default ();
+
+      g_signal_handler_disconnect (manager, priv->stage_added_id);
+      g_signal_handler_disconnect (manager, priv->stage_removed_id);
+      priv->stage_added_id = 0;
+      priv->stage_removed_id = 0;
+    }
+
+  g_hash_table_remove_all (priv->stage_timings);
+  priv->paint_stage = NULL;
+  priv->lateness_stage = NULL;
+  priv->lateness_pending = FALSE;
+  g_atomic_int_set (&priv->clutter_setup, FALSE);
+
   if (priv->source)
     {
       GSource *source = (GSource *) priv->source;
@@ -2217,9 +5149,125 @@ clutter_gst_video_sink_stop (GstBaseSink *base_sink)
       priv->source = NULL;
     }
 
+  if (priv->dispatch_context)
+    {
+      g_main_context_unref (priv->dispatch_context);
+      priv->dispatch_context = NULL;
+    }
+
   return TRUE;
 }
 
+static void
+clutter_gst_video_sink_reset_stats (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  GST_OBJECT_LOCK (sink);
+  memset (&priv->stats, 0, sizeof (priv->stats));
+  memset (&priv->dispatch_latency, 0, sizeof (priv->dispatch_latency));
+  memset (&priv->paint_lateness, 0, sizeof (priv->paint_lateness));
+  memset (&priv->cadence, 0, sizeof (priv->cadence));
+  priv->qos_proportion = 1.0;
+  g_hash_table_remove_all (priv->upload_timings);
+  GST_OBJECT_UNLOCK (sink);
+}
+
+static GstStructure *
+clutter_gst_video_sink_get_stats (ClutterGstVideoSink *sink)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstVideoSinkStats *stats = &priv->stats;
+  GValue upload_times = G_VALUE_INIT;
+  GHashTableIter iter;
+  gpointer key, value;
+  GstStructure *latency, *lateness, *cadence, *prewarm, *structure;
+
+  structure =
+    gst_structure_new ("ClutterGstVideoSinkStats",
+                       "rendered", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->rendered),
+                       "dropped", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->dropped),
+                       "overflowed", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->overflowed),
+                       "uploaded", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->uploaded),
+                       "upload-failures", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->upload_failures),
+                       "renegotiations", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->renegotiations),
+                       "pipeline-rebuilds", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->pipeline_rebuilds),
+                       "texture-swaps", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->texture_swaps),
+                       "texture-pool-hits", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->texture_pool_hits),
+                       "texture-pool-misses", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->texture_pool_misses),
+                       "pixel-buffer-uploads", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->pbo_uploads),
+                       "copy-uploads", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->copy_uploads),
+                       "pixel-buffer-fallbacks", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->pbo_fallbacks),
+                       "staged", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->staged),
+                       "late", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->late),
+                       "repeated", G_TYPE_UINT64,
+                       (guint64) (guint) g_atomic_int_get (&stats->repeated),
+                       NULL);
+
+  g_value_init (&upload_times, GST_TYPE_ARRAY);
+
+  GST_OBJECT_LOCK (sink);
+
+  gst_structure_set (structure,
+                     "display-delay", G_TYPE_UINT64, priv->display_delay,
+                     NULL);
+
+  latency = clutter_gst_timing_to_structure (&priv->dispatch_latency,
+                                             "dispatch-latency");
+  lateness = clutter_gst_timing_to_structure (&priv->paint_lateness,
+                                              "paint-lateness");
+  cadence = clutter_gst_timing_to_structure (&priv->cadence, "cadence");
+  prewarm = clutter_gst_timing_to_structure (&priv->prewarm_timing,
+                                             "prewarm-time");
+
+  g_hash_table_iter_init (&iter, priv->upload_timings);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      ClutterGstRenderer *renderer = key;
+      GValue item = G_VALUE_INIT;
+      GstStructure *timing;
+
+      timing = clutter_gst_timing_to_structure (value, "upload-time");
+      gst_structure_set (timing, "renderer", G_TYPE_STRING, renderer->name,
+                         NULL);
+
+      g_value_init (&item, GST_TYPE_STRUCTURE);
+      g_value_take_boxed (&item, timing);
+      gst_value_array_append_and_take_value (&upload_times, &item);
+    }
+
+  GST_OBJECT_UNLOCK (sink);
+
+  gst_structure_set (structure,
+                     "dispatch-latency", GST_TYPE_STRUCTURE, latency,
+                     "paint-lateness", GST_TYPE_STRUCTURE, lateness,
+                     "cadence", GST_TYPE_STRUCTURE, cadence,
+                     "prewarm-time", GST_TYPE_STRUCTURE, prewarm,
+                     NULL);
+  gst_structure_take_value (structure, "upload-times", &upload_times);
+  gst_structure_free (latency);
+  gst_structure_free (lateness);
+  gst_structure_free (cadence);
+  gst_structure_free (prewarm);
+
+  return structure;
+}
+
 static void
 clutter_gst_video_sink_set_property (GObject *object,
                                      unsigned int prop_id,
@@ -2233,6 +5281,51 @@ clutter_gst_video_sink_set_property (GObject *object,
     case PROP_UPDATE_PRIORITY:
       clutter_gst_video_sink_set_priority (sink, g_value_get_int (value));
       break;
+    case PROP_UPLOAD_ON_PAINT:
+      sink->priv->upload_on_paint = g_value_get_boolean (value);
+      break;
+    case PROP_MAIN_CONTEXT:
+      {
+        GMainContext *context = g_value_dup_boxed (value);
+
+        GST_OBJECT_LOCK (sink);
+        if (sink->priv->main_context)
+          g_main_context_unref (sink->priv->main_context);
+        sink->priv->main_context = context;
+        GST_OBJECT_UNLOCK (sink);
+      }
+      break;
+    case PROP_THREADED_UPLOAD:
+      sink->priv->threaded_upload = g_value_get_boolean (value);
+      break;
+    case PROP_GL_TEXTURE_RING_SIZE:
+      sink->priv->gl_texture_ring_size = g_value_get_uint (value);
+      break;
+    case PROP_VBLANK_ALIGNED:
+      sink->priv->vblank_aligned = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_FPS:
+      {
+        GstClockTime throttle_time = 0;
+
+        sink->priv->max_fps = g_value_get_double (value);
+
+        /* Tiny rates would overflow the conversion to a clock time */
+        if (sink->priv->max_fps > 0)
+          throttle_time = MIN (GST_SECOND / sink->priv->max_fps,
+                               (gdouble) MAX_THROTTLE_TIME);
+
+        /* basesink drops the buffers coming too soon after the last one
+         * rendered before they reach us, throttling QoS events are sent
+         * upstream once frames are painted for decoders to skip them in
+         * the first place */
+        gst_base_sink_set_throttle_time (GST_BASE_SINK (sink),
+                                         throttle_time);
+      }
+      break;
+    case PROP_QOS:
+      g_atomic_int_set (&sink->priv->qos_enabled, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -2253,23 +5346,193 @@ clutter_gst_video_sink_get_property (GObject *object,
     case PROP_UPDATE_PRIORITY:
       g_value_set_int (value, g_source_get_priority ((GSource *) priv->source));
       break;
+    case PROP_STATS:
+      g_value_take_boxed (value, clutter_gst_video_sink_get_stats (sink));
+      break;
+    case PROP_UPLOAD_ON_PAINT:
+      g_value_set_boolean (value, priv->upload_on_paint);
+      break;
+    case PROP_MAIN_CONTEXT:
+      GST_OBJECT_LOCK (sink);
+      g_value_set_boxed (value, priv->main_context);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+    case PROP_THREADED_UPLOAD:
+      g_value_set_boolean (value, priv->threaded_upload);
+      break;
+    case PROP_GL_TEXTURE_RING_SIZE:
+      g_value_set_uint (value, priv->gl_texture_ring_size);
+      break;
+    case PROP_VBLANK_ALIGNED:
+      g_value_set_boolean (value, priv->vblank_aligned);
+      break;
+    case PROP_MAX_FPS:
+      g_value_set_double (value, priv->max_fps);
+      break;
+    case PROP_QOS:
+      g_value_set_boolean (value, g_atomic_int_get (&priv->qos_enabled));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
     }
 }
 
+static gboolean
+clutter_gst_video_sink_unlock (GstBaseSink *base_sink)
+{
+  ClutterGstVideoSink *sink = CLUTTER_GST_VIDEO_SINK (base_sink);
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  if (priv->allocator)
+    clutter_gst_pixel_buffer_allocator_set_flushing (priv->allocator, TRUE);
+
+  return TRUE;
+}
+
+static gboolean
+clutter_gst_video_sink_unlock_stop (GstBaseSink *base_sink)
+{
+  ClutterGstVideoSink *sink = CLUTTER_GST_VIDEO_SINK (base_sink);
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+
+  if (priv->allocator && priv->source)
+    clutter_gst_pixel_buffer_allocator_set_flushing (priv->allocator, FALSE);
+
+  return TRUE;
+}
+
+static GstBufferPool *
+clutter_gst_video_sink_get_pool (ClutterGstVideoSink *sink,
+                                 GstCaps *caps,
+                                 guint size)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+
+  GST_OBJECT_LOCK (sink);
+  if (priv->pool)
+    pool = gst_object_ref (priv->pool);
+  GST_OBJECT_UNLOCK (sink);
+
+  if (pool)
+    {
+      GstCaps *pool_caps;
+
+      config = gst_buffer_pool_get_config (pool);
+      gst_buffer_pool_config_get_params (config, &pool_caps, NULL, NULL, NULL);
+
+      if (gst_caps_is_equal (caps, pool_caps))
+        {
+          gst_structure_free (config);
+          return pool;
+        }
+
+      GST_DEBUG_OBJECT (sink, "pool has different caps");
+      gst_structure_free (config);
+      gst_object_unref (pool);
+    }
+
+  pool = clutter_gst_video_sink_new_pool (sink, caps, size, MIN_BUFFERS, 0,
+                                          PIXEL_BUFFER_SPARES);
+  if (pool == NULL)
+    return NULL;
+
+  GST_OBJECT_LOCK (sink);
+  if (priv->pool)
+    gst_object_unref (priv->pool);
+  priv->pool = gst_object_ref (pool);
+  GST_OBJECT_UNLOCK (sink);
+
+  return pool;
+}
+
 static gboolean
 clutter_gst_video_sink_propose_allocation (GstBaseSink *base_sink, GstQuery *query)
 {
+  ClutterGstVideoSink *sink = CLUTTER_GST_VIDEO_SINK (base_sink);
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
   gboolean need_pool = FALSE;
+  gboolean pool_added = FALSE;
   GstCaps *caps = NULL;
 
   gst_query_parse_allocation (query, &caps, &need_pool);
 
+  /* Propose buffers backed by pixel buffers to software decoders, so
+   * the frames can be uploaded without an extra copy. Upstream is free
+   * to ignore them, in which case we copy the frames as before. */
+  if (need_pool && caps != NULL && priv->allocator != NULL)
+    {
+      GstCapsFeatures *features = gst_caps_get_features (caps, 0);
+      ClutterGstRenderer *renderer;
+      GstVideoInfo info;
+
+      if (gst_caps_features_contains (features,
+                                      GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY) &&
+          clutter_gst_video_sink_parse_caps (caps, sink, FALSE, &renderer) &&
+          !clutter_gst_renderer_converts_on_cpu (renderer) &&
+          gst_video_info_from_caps (&info, caps))
+        {
+          GstBufferPool *pool;
+
+          pool = clutter_gst_video_sink_get_pool (sink, caps, info.size);
+
+          /* A pool handing out system memory would only get in the way
+           * of upstream using its own. Upstream configuring the pool
+           * again reserves pixel buffers of the size it ends up with. */
+          if (pool && !clutter_gst_pixel_buffer_pool_is_reserved (pool))
+            {
+              GST_DEBUG_OBJECT (sink, "no pixel buffers, not proposing a pool");
+              gst_object_unref (pool);
+              pool = NULL;
+            }
+
+          if (pool)
+            {
+              gst_query_add_allocation_pool (query, pool, info.size,
+                                             MIN_BUFFERS, 0);
+              gst_query_add_allocation_param (query, priv->allocator, NULL);
+              gst_object_unref (pool);
+              pool_added = TRUE;
+            }
+        }
+    }
+
+  /* Upstream allocating on its own still has to know how many buffers
+   * we hold on to */
+  if (!pool_added && caps != NULL &&
+      gst_caps_features_contains (gst_caps_get_features (caps, 0),
+                                  GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY))
+    {
+      GstVideoInfo info;
+
+      if (gst_video_info_from_caps (&info, caps))
+        gst_query_add_allocation_pool (query, NULL, info.size, MIN_BUFFERS, 0);
+    }
+
   gst_query_add_allocation_meta (query,
                                  GST_VIDEO_META_API_TYPE, NULL);
+  gst_query_add_allocation_meta (query,
+                                 GST_VIDEO_CROP_META_API_TYPE, NULL);
+#if GST_CHECK_VERSION (1, 8, 0)
+  gst_query_add_allocation_meta (query,
+                                 GST_VIDEO_AFFINE_TRANSFORMATION_META_API_TYPE,
+                                 NULL);
+#endif
 #ifdef HAVE_GL_TEXTURE_UPLOAD
+  /* Each texture set holds on to the buffer it was uploaded from, let
+   * upstream know it needs that many buffers in flight */
+  if (caps != NULL &&
+      gst_caps_features_contains (gst_caps_get_features (caps, 0),
+                                  GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META))
+    {
+      GstVideoInfo info;
+
+      if (gst_video_info_from_caps (&info, caps))
+        gst_query_add_allocation_pool (query, NULL, info.size,
+                                       priv->gl_texture_ring_size + 1, 0);
+    }
 
   gst_query_add_allocation_meta (query,
                                  GST_VIDEO_GL_TEXTURE_UPLOAD_META_API_TYPE, NULL);
@@ -2289,13 +5552,32 @@ clutter_gst_video_sink_event (GstBaseSink * basesink, GstEvent * event)
 
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_FLUSH_START:
-      g_mutex_lock (&gst_source->buffer_lock);
-      if (gst_source->buffer) {
-        GST_DEBUG ("Freeing existing buffer %p", gst_source->buffer);
-        gst_buffer_unref (gst_source->buffer);
-        gst_source->buffer = NULL;
+      /* Queued frames are released by the next dispatch */
+      GST_DEBUG_OBJECT (sink, "Flushing queued frames");
+      g_atomic_int_inc (&gst_source->flush_seqnum);
+      g_main_context_wakeup (priv->dispatch_context);
+      break;
+
+    case GST_EVENT_STREAM_START:
+      g_atomic_int_set (&priv->tag_orientation,
+                        CLUTTER_GST_VIDEO_ORIENTATION_IDENTITY);
+      break;
+
+    case GST_EVENT_TAG:
+      {
+        GstTagList *tags;
+        gchar *orientation;
+
+        gst_event_parse_tag (event, &tags);
+        if (gst_tag_list_get_string (tags, GST_TAG_IMAGE_ORIENTATION,
+                                     &orientation))
+          {
+            GST_DEBUG_OBJECT (sink, "image orientation: %s", orientation);
+            g_atomic_int_set (&priv->tag_orientation,
+                              clutter_gst_orientation_from_tag (orientation));
+            g_free (orientation);
+          }
       }
-      g_mutex_unlock (&gst_source->buffer_lock);
       break;
 
     default:
@@ -2346,6 +5628,8 @@ clutter_gst_video_sink_class_init (ClutterGstVideoSinkClass *klass)
   gb_class->set_caps = clutter_gst_video_sink_set_caps;
   gb_class->get_caps = clutter_gst_video_sink_get_caps;
   gb_class->propose_allocation = clutter_gst_video_sink_propose_allocation;
+  gb_class->unlock = clutter_gst_video_sink_unlock;
+  gb_class->unlock_stop = clutter_gst_video_sink_unlock_stop;
   gb_class->event = clutter_gst_video_sink_event;
 
   gv_class->show_frame = _clutter_gst_video_sink_show_frame;
@@ -2359,6 +5643,192 @@ clutter_gst_video_sink_class_init (ClutterGstVideoSinkClass *klass)
 
   g_object_class_install_property (go_class, PROP_UPDATE_PRIORITY, pspec);
 
+  /**
+   * ClutterGstVideoSink:stats:
+   *
+   * Statistics about the frames going through the sink, as a
+   * #GstStructure holding the following #guint64 counters since the
+   * sink was last started: "rendered" (buffers received from upstream),
+   * "dropped" (buffers replaced by a newer one before the main loop
+   * got to them), "overflowed" (buffers dropped because the main loop
+   * was too far behind), "uploaded", "upload-failures",
+   * "renegotiations", "pipeline-rebuilds", "texture-swaps" (frames for
+   * which the textures of the pipeline had to be replaced),
+   * "texture-pool-hits", "texture-pool-misses", "pixel-buffer-uploads",
+   * "copy-uploads", "pixel-buffer-fallbacks" (buffers from the sink's
+   * pools that got system memory as no pixel buffer was ready in
+   * time), "staged" (buffers copied into pixel buffers by
+   * the streaming thread, see #ClutterGstVideoSink:threaded-upload),
+   * "late" (frames painted after the next one was due) and "repeated"
+   * (buffers wrapping the memory of the frame already displayed, which
+   * are not uploaded again). The "display-delay" field holds the
+   * delay in nanoseconds measured between basesink rendering a frame
+   * and that frame reaching the screen, it is added to the latency
+   * reported by the sink.
+   *
+   * The "dispatch-latency" field is a #GstStructure with the "count",
+   * "min", "average" and "max" delay in nanoseconds between a buffer
+   * being received and the main loop picking it up. The
+   * "paint-lateness" field measures in the same way how late frames
+   * reached the screen compared to their running time, this is what
+   * the QoS events sent upstream are based on. The "cadence" field
+   * measures how much the interval between two frames being painted
+   * differed from the interval between their running times, the
+   * lower the smoother the playback. The "upload-times"
+   * field is an array of such structures, one per renderer used, with
+   * an additional "renderer" field, measuring the time spent uploading
+   * buffers on the CPU side. The "prewarm-time" field measures the
+   * calls to clutter_gst_video_sink_prewarm(), it isn't reset when the
+   * sink starts.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_boxed ("stats",
+                              "Statistics",
+                              "Sink statistics",
+                              GST_TYPE_STRUCTURE,
+                              CLUTTER_GST_PARAM_READABLE);
+
+  g_object_class_install_property (go_class, PROP_STATS, pspec);
+
+  /**
+   * ClutterGstVideoSink:upload-on-paint:
+   *
+   * Whether frames should be uploaded right before the stages are laid
+   * out and painted, instead of as soon as the main loop gets to them.
+   * At most one frame is then uploaded per stage frame, frames replaced
+   * by a newer one before the next stage frame are never uploaded.
+   *
+   * Changing this property only takes effect the next time the sink
+   * is started.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_boolean ("upload-on-paint",
+                                "Upload on paint",
+                                "Upload frames when the stages are painted",
+                                FALSE,
+                                CLUTTER_GST_PARAM_READWRITE);
+
+  g_object_class_install_property (go_class, PROP_UPLOAD_ON_PAINT, pspec);
+
+  /**
+   * ClutterGstVideoSink:main-context:
+   *
+   * The #GMainContext frames are uploaded from. If unset, the global
+   * default context is used. The context is picked up when the sink is
+   * started, changing it afterwards only applies from the next start.
+   *
+   * The context has to be iterated from the thread Clutter runs in,
+   * while its main loop is running, for instance from a nested loop:
+   * the uploads and the stage repaint functions share their state
+   * without locking. The sink errors out when it is dispatched from
+   * another thread.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_boxed ("main-context",
+                              "Main context",
+                              "The main context frames are uploaded from",
+                              G_TYPE_MAIN_CONTEXT,
+                              CLUTTER_GST_PARAM_READWRITE);
+
+  g_object_class_install_property (go_class, PROP_MAIN_CONTEXT, pspec);
+
+  /**
+   * ClutterGstVideoSink:threaded-upload:
+   *
+   * Whether frames that upstream didn't decode into the sink's pixel
+   * buffers should be copied into some from the streaming thread.
+   *
+   * No GL work happens outside of the main loop. It only queues the
+   * transfer of the frames from the pixel buffers into textures, and
+   * doesn't copy them itself. The GL driver then performs the transfer
+   * asynchronously: the pixel buffers are only mapped back for the
+   * streaming thread once the next frame gets uploaded. This requires
+   * pixel buffer support and takes effect on the next caps change.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_boolean ("threaded-upload",
+                                "Threaded upload",
+                                "Copy frames into pixel buffers from the "
+                                "streaming thread",
+                                FALSE,
+                                CLUTTER_GST_PARAM_READWRITE);
+
+  g_object_class_install_property (go_class, PROP_THREADED_UPLOAD, pspec);
+
+  /**
+   * ClutterGstVideoSink:gl-texture-ring-size:
+   *
+   * Number of sets of textures frames using the GL texture upload meta
+   * are uploaded into in turn. A set, and the buffer it was uploaded
+   * from, is only reused once this many newer frames have been
+   * uploaded, so that the textures being displayed are never written
+   * to. Takes effect on the next caps change.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_uint ("gl-texture-ring-size",
+                             "GL texture ring size",
+                             "Number of texture sets used for GL uploads",
+                             1, 16, DEFAULT_GL_TEXTURE_RING_SIZE,
+                             CLUTTER_GST_PARAM_READWRITE);
+
+  g_object_class_install_property (go_class, PROP_GL_TEXTURE_RING_SIZE, pspec);
+
+  /**
+   * ClutterGstVideoSink:vblank-aligned:
+   *
+   * Whether frames should be picked according to the time the stage
+   * frame being painted will be presented at, rather than as soon as
+   * they are released. Frames are then received ahead of time and
+   * uploaded on paint, each stage frame showing the frame due at its
+   * vblank. This avoids irregular cadences when the frame rate of the
+   * video doesn't match the refresh rate of the display. The
+   * presentation times are only known with Clutter 1.22 or newer, the
+   * refresh rate is otherwise assumed to be 60Hz.
+   *
+   * Changing this property only takes effect the next time the sink
+   * is started.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_boolean ("vblank-aligned",
+                                "VBlank aligned",
+                                "Pick frames according to the vblank they "
+                                "will be presented at",
+                                FALSE,
+                                CLUTTER_GST_PARAM_READWRITE);
+
+  g_object_class_install_property (go_class, PROP_VBLANK_ALIGNED, pspec);
+
+  /**
+   * ClutterGstVideoSink:max-fps:
+   *
+   * Maximum number of frames per second to display, 0 for no limit.
+   * Frames coming in faster than that are dropped before being
+   * uploaded, and upstream is asked to skip them through QoS events,
+   * saving the decoding of most of them. This is useful when many
+   * videos are shown at a small size. Rates below one frame per hour
+   * are treated as one frame per hour.
+   *
+   * Since: 3.0
+   */
+  pspec = g_param_spec_double ("max-fps",
+                               "Maximum frame rate",
+                               "Maximum number of frames displayed per "
+                               "second, 0 for no limit",
+                               0.0, G_MAXDOUBLE, 0.0,
+                               CLUTTER_GST_PARAM_READWRITE);
+
+  g_object_class_install_property (go_class, PROP_MAX_FPS, pspec);
+
+  /* Handled by the sink instead of basesink, which would send QoS
+   * events of its own */
+  g_object_class_override_property (go_class, PROP_QOS, "qos");
+
   /**
    * ClutterGstVideoSink::pipeline-ready:
    * @sink: the #ClutterGstVideoSink
@@ -2524,7 +5994,7 @@ clutter_gst_video_sink_get_frame (ClutterGstVideoSink *sink)
 
   if (priv->clt_frame != NULL && priv->clt_frame->pipeline != pipeline)
     {
-      g_boxed_free (CLUTTER_GST_TYPE_FRAME, priv->clt_frame);
+      clutter_gst_frame_unref (priv->clt_frame);
       priv->clt_frame = NULL;
     }
 
@@ -2534,6 +6004,12 @@ clutter_gst_video_sink_get_frame (ClutterGstVideoSink *sink)
       priv->clt_frame->pipeline = cogl_object_ref (pipeline);
       clutter_gst_video_resolution_from_video_info (&priv->clt_frame->resolution,
                                                     &priv->info);
+      if (priv->crop_width > 0 && priv->crop_height > 0)
+        {
+          priv->clt_frame->resolution.width = priv->crop_width;
+          priv->clt_frame->resolution.height = priv->crop_height;
+        }
+      priv->clt_frame->orientation = priv->orientation;
     }
 
   return priv->clt_frame;
@@ -2550,8 +6026,9 @@ clutter_gst_video_sink_get_frame (ClutterGstVideoSink *sink)
  * video. It can then just paint a rectangle using the returned
  * pipeline.
  *
- * An application is free to make a copy of this
- * pipeline and modify it for custom rendering.
+ * The same pipeline is returned, with its textures updated, until
+ * the format of the video changes. An application is free to make a
+ * copy of this pipeline and modify it for custom rendering.
  *
  * Note: it is considered an error to call this function before the
  * #ClutterGstVideoSink::pipeline-ready signal is emitted.
@@ -2578,26 +6055,27 @@ clutter_gst_video_sink_get_pipeline (ClutterGstVideoSink *sink)
       clutter_gst_video_sink_setup_pipeline (sink, priv->pipeline);
       clutter_gst_video_sink_attach_frame (sink, priv->pipeline);
       priv->balance_dirty = FALSE;
+      g_atomic_int_inc (&priv->stats.pipeline_rebuilds);
     }
-  else if (priv->balance_dirty)
+  else if (priv->frame_dirty)
     {
-      cogl_object_unref (priv->pipeline);
-      priv->pipeline = cogl_pipeline_new (priv->ctx);
-
-      clutter_gst_video_sink_setup_pipeline (sink, priv->pipeline);
+      /* The pipeline is kept for as long as the configuration doesn't
+       * change, only the textures that got reallocated are swapped */
       clutter_gst_video_sink_attach_frame (sink, priv->pipeline);
-      priv->balance_dirty = FALSE;
+      g_atomic_int_inc (&priv->stats.texture_swaps);
     }
-  else if (priv->frame_dirty)
-    {
-      CoglPipeline *pipeline = cogl_pipeline_copy (priv->pipeline);
-      cogl_object_unref (priv->pipeline);
-      priv->pipeline = pipeline;
+  else if (priv->texture_matrix_dirty)
+    clutter_gst_video_sink_update_texture_matrix (sink, priv->pipeline);
 
-      clutter_gst_video_sink_attach_frame (sink, pipeline);
+  if (priv->balance_dirty)
+    {
+      if (priv->renderer->flags & CLUTTER_GST_RENDERER_NEEDS_GLSL)
+        clutter_gst_video_sink_update_color_matrix (sink, priv->pipeline);
+      priv->balance_dirty = FALSE;
     }
 
   priv->frame_dirty = FALSE;
+  priv->texture_matrix_dirty = FALSE;
 
   return priv->pipeline;
 }
@@ -2631,12 +6109,242 @@ clutter_gst_video_sink_setup_pipeline (ClutterGstVideoSink *sink,
 
   if (priv->renderer)
     {
-      clutter_gst_video_sink_setup_conversions (sink, priv->pipeline);
-      clutter_gst_video_sink_setup_balance (sink, priv->pipeline);
-      priv->renderer->setup_pipeline (sink, priv->pipeline);
+      priv->video_start = priv->custom_start;
+
+      if (priv->renderer->flags & CLUTTER_GST_RENDERER_NEEDS_GLSL)
+        clutter_gst_video_sink_setup_color (sink, pipeline);
+      priv->renderer->setup_pipeline (sink, pipeline);
+    }
+}
+
+
+static void
+clutter_gst_collect_formats (const GValue *value,
+                             GArray *formats)
+{
+  if (GST_VALUE_HOLDS_LIST (value))
+    {
+      guint i;
+
+      for (i = 0; i < gst_value_list_get_size (value); i++)
+        clutter_gst_collect_formats (gst_value_list_get_value (value, i),
+                                     formats);
+    }
+  else if (G_VALUE_HOLDS_STRING (value))
+    {
+      GstVideoFormat format =
+        gst_video_format_from_string (g_value_get_string (value));
+      guint i;
+
+      for (i = 0; i < formats->len; i++)
+        if (g_array_index (formats, GstVideoFormat, i) == format)
+          return;
+
+      if (format != GST_VIDEO_FORMAT_UNKNOWN)
+        g_array_append_val (formats, format);
     }
 }
 
+/* Builds the pipeline a stream negotiated with @caps would use and
+ * draws it once, so that Cogl generates, compiles and links its
+ * program */
+static gboolean
+clutter_gst_video_sink_prewarm_caps (ClutterGstVideoSink *sink,
+                                     GstCaps *caps,
+                                     CoglFramebuffer *framebuffer,
+                                     CoglTexture *texture)
+{
+  ClutterGstVideoSinkPrivate *priv = sink->priv;
+  ClutterGstRenderer *renderer = priv->renderer;
+  ClutterGstVideoFormat format = priv->format;
+  GstVideoInfo info = priv->info;
+  gboolean bgr = priv->bgr;
+  gboolean gl_upload = priv->gl_upload;
+  int video_start = priv->video_start;
+  CoglPipeline *pipeline;
+  guint i;
+
+  if (!gst_caps_can_intersect (priv->caps, caps))
+    return FALSE;
+
+  if (!clutter_gst_video_sink_parse_caps (caps, sink, TRUE, NULL))
+    return FALSE;
+
+  pipeline = cogl_pipeline_new (priv->ctx);
+  clutter_gst_video_sink_setup_pipeline (sink, pipeline);
+  for (i = 0; i < priv->renderer->n_layers; i++)
+    cogl_pipeline_set_layer_texture (pipeline, priv->video_start + i,
+                                     texture);
+
+  cogl_framebuffer_draw_rectangle (framebuffer, pipeline,
+                                   -1.0f, 1.0f, 1.0f, -1.0f);
+  cogl_object_unref (pipeline);
+
+  GST_DEBUG_OBJECT (sink, "prewarmed the %s renderer for %" GST_PTR_FORMAT,
+                    priv->renderer->name, caps);
+
+  priv->renderer = renderer;
+  priv->format = format;
+  priv->info = info;
+  priv->bgr = bgr;
+  priv->gl_upload = gl_upload;
+  priv->video_start = video_start;
+
+  return TRUE;
+}
+
+/**
+ * clutter_gst_video_sink_prewarm:
+ * @sink: The #ClutterGstVideoSink
+ * @formats: (array length=n_formats) (allow-none): the video formats
+ *   to prepare the sink for, or %NULL for all the supported formats
+ * @n_formats: the number of elements in @formats
+ * @flags: a combination of #ClutterGstPrewarmFlags
+ *
+ * Builds and draws, into a 1x1 offscreen framebuffer, the pipeline
+ * each of the given formats would be rendered with. Cogl then
+ * compiles and links the shader programs up front rather than when
+ * the first frame of a stream gets painted, which can cause a visible
+ * stall.
+ *
+ * The color balance is applied through a uniform of these programs,
+ * changing it later on doesn't require any new program.
+ *
+ * This must be called from the thread the Cogl context is used from,
+ * while the sink isn't streaming. The time spent is logged and
+ * reported in the "prewarm-time" field of the
+ * #ClutterGstVideoSink:stats property.
+ *
+ * Return value: %TRUE if a pipeline could be prepared for each of the
+ *   requested formats
+ * Since: 3.0
+ */
+gboolean
+clutter_gst_video_sink_prewarm (ClutterGstVideoSink    *sink,
+                                const GstVideoFormat   *formats,
+                                guint                   n_formats,
+                                ClutterGstPrewarmFlags  flags)
+{
+  ClutterGstVideoSinkPrivate *priv;
+  CoglTexture *target = NULL, *texture = NULL;
+  CoglOffscreen *offscreen = NULL;
+  CoglFramebuffer *framebuffer;
+  GArray *all_formats = NULL;
+  CoglError *error = NULL;
+  static const guint8 pixel[4] = { 0x80, 0x80, 0x80, 0xff };
+  gboolean ret = TRUE;
+  GstClockTime elapsed;
+  gint64 start;
+  guint i;
+
+  g_return_val_if_fail (CLUTTER_GST_IS_VIDEO_SINK (sink), FALSE);
+  g_return_val_if_fail (formats != NULL || n_formats == 0, FALSE);
+
+  priv = sink->priv;
+
+  if (GST_STATE (sink) > GST_STATE_READY)
+    {
+      GST_WARNING_OBJECT (sink, "Can't prewarm a streaming sink");
+      return FALSE;
+    }
+
+  start = g_get_monotonic_time ();
+
+  if (formats == NULL)
+    {
+      all_formats = g_array_new (FALSE, FALSE, sizeof (GstVideoFormat));
+
+      for (i = 0; i < gst_caps_get_size (priv->caps); i++)
+        {
+          GstStructure *structure = gst_caps_get_structure (priv->caps, i);
+
+          clutter_gst_collect_formats (gst_structure_get_value (structure,
+                                                                "format"),
+                                       all_formats);
+        }
+
+      formats = (const GstVideoFormat *) all_formats->data;
+      n_formats = all_formats->len;
+    }
+
+  target = COGL_TEXTURE (cogl_texture_2d_new_with_size (priv->ctx, 1, 1));
+  offscreen = cogl_offscreen_new_with_texture (target);
+  framebuffer = COGL_FRAMEBUFFER (offscreen);
+  if (!cogl_framebuffer_allocate (framebuffer, &error))
+    goto allocation_failed;
+
+  texture =
+    COGL_TEXTURE (cogl_texture_2d_new_from_data (priv->ctx, 1, 1,
+                                                 COGL_PIXEL_FORMAT_RGBA_8888,
+                                                 4, pixel, &error));
+  if (texture == NULL)
+    goto allocation_failed;
+
+  for (i = 0; i < n_formats; i++)
+    {
+      GstCaps *caps;
+
+      /* Odd sizes would give the subsampled formats a different
+       * layout, that doesn't matter for the programs */
+      caps = gst_caps_new_simple ("video/x-raw",
+                                  "format", G_TYPE_STRING,
+                                  gst_video_format_to_string (formats[i]),
+                                  "width", G_TYPE_INT, 16,
+                                  "height", G_TYPE_INT, 16,
+                                  NULL);
+
+      if (!clutter_gst_video_sink_prewarm_caps (sink, caps, framebuffer,
+                                                texture))
+        {
+          GST_WARNING_OBJECT (sink, "Couldn't prewarm for %s",
+                              gst_video_format_to_string (formats[i]));
+          ret = FALSE;
+        }
+
+      if (flags & CLUTTER_GST_PREWARM_FLAG_GL_TEXTURE_UPLOAD)
+        {
+          gst_caps_set_features (caps, 0,
+                                 gst_caps_features_new (GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META,
+                                                        NULL));
+          /* Not all the formats can come as GL textures */
+          clutter_gst_video_sink_prewarm_caps (sink, caps, framebuffer,
+                                               texture);
+        }
+
+      gst_caps_unref (caps);
+    }
+
+  /* The drivers usually only compile on the first draw */
+  cogl_framebuffer_finish (framebuffer);
+
+  elapsed = (g_get_monotonic_time () - start) * GST_USECOND;
+
+  GST_INFO_OBJECT (sink, "prewarming %u formats took %" GST_TIME_FORMAT,
+                   n_formats, GST_TIME_ARGS (elapsed));
+
+  GST_OBJECT_LOCK (sink);
+  clutter_gst_timing_add (&priv->prewarm_timing, elapsed);
+  GST_OBJECT_UNLOCK (sink);
+
+ done:
+  if (texture)
+    cogl_object_unref (texture);
+  cogl_object_unref (offscreen);
+  cogl_object_unref (target);
+  if (all_formats)
+    g_array_free (all_formats, TRUE);
+
+  return ret;
+
+ allocation_failed:
+  {
+    GST_WARNING_OBJECT (sink, "Couldn't allocate prewarm resources: %s",
+                        error->message);
+    cogl_error_free (error);
+    ret = FALSE;
+    goto done;
+  }
+}
 
 ClutterGstOverlays *
 clutter_gst_video_sink_get_overlays (ClutterGstVideoSink *sink)
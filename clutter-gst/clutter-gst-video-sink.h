@@ -36,6 +36,7 @@
 #define __CLUTTER_GST_VIDEO_SINK_H__
 
 #include <cogl/cogl.h>
+#include <gst/video/video.h>
 #include <gst/video/gstvideosink.h>
 #include <clutter-gst/clutter-gst-types.h>
 
@@ -67,6 +68,23 @@ typedef struct _ClutterGstVideoSink ClutterGstVideoSink;
 typedef struct _ClutterGstVideoSinkClass ClutterGstVideoSinkClass;
 typedef struct _ClutterGstVideoSinkPrivate ClutterGstVideoSinkPrivate;
 
+/**
+ * ClutterGstPrewarmFlags:
+ * @CLUTTER_GST_PREWARM_FLAG_NONE: Only the pipelines of buffers in
+ *   system memory
+ * @CLUTTER_GST_PREWARM_FLAG_GL_TEXTURE_UPLOAD: Also the pipelines of
+ *   buffers uploaded through the GL texture upload meta
+ *
+ * Flags that can be given to clutter_gst_video_sink_prewarm().
+ *
+ * Since: 3.0
+ */
+typedef enum _ClutterGstPrewarmFlags
+{
+  CLUTTER_GST_PREWARM_FLAG_NONE              = 0,
+  CLUTTER_GST_PREWARM_FLAG_GL_TEXTURE_UPLOAD = 1 << 0
+} ClutterGstPrewarmFlags;
+
 /**
  * ClutterGstVideoSink:
  *
@@ -119,6 +137,11 @@ void                  clutter_gst_video_sink_setup_pipeline (ClutterGstVideoSink
 
 ClutterGstOverlays *  clutter_gst_video_sink_get_overlays   (ClutterGstVideoSink *sink);
 
+gboolean              clutter_gst_video_sink_prewarm        (ClutterGstVideoSink    *sink,
+                                                             const GstVideoFormat   *formats,
+                                                             guint                   n_formats,
+                                                             ClutterGstPrewarmFlags  flags);
+
 G_END_DECLS
 
 #endif